@@ -17,29 +17,63 @@
 #define CameraCalibration_hpp
 
 #include <filesystem>
+#include <future>
+#include <vector>
 
 #include "demosaic.hpp"
 #include "raw_converter.hpp"
+#include "raw_batch_reader.hpp"
+#include "image_writer.hpp"
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX492DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+// Runs process(rawImage, index, imageWriter) on each raw file in paths, in order. Up to depth files are decoded ahead on
+// background threads, and the image write returned by process is completed in the background: all writes have
+// completed, or their first error is rethrown, when this returns. See RawBatchReader and ImageWriter.
+template <typename F>
+void forEachRawImage(std::vector<std::filesystem::path> paths, int depth, F process,
+                     gls::tiff_metadata dngDefaults = gls::tiff_metadata(), gls::OpenCLContext* glsContext = nullptr) {
+    RawBatchReader rawBatchReader(std::move(paths), depth, std::move(dngDefaults));
+    ImageWriter imageWriter(glsContext);
+
+    std::vector<std::future<void>> pendingWrites;
+    for (int index = 0; const auto rawImage = rawBatchReader.next(); index++) {
+        pendingWrites.push_back(process(rawImage.get(), index, &imageWriter));
+    }
+
+    for (auto& write : pendingWrites) {
+        write.get();
+    }
+}
+
+// Glass cameras: their DNG files are read with these tags, which override the ones in the files
+gls::tiff_metadata IMX492DngDefaults();
+gls::tiff_metadata IMX571DngDefaults();
+
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX492DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX492DNG(RawConverter* rawConverter, RawImage* rawImage);
 void calibrateIMX492(RawConverter* rawConverter, const std::filesystem::path& input_dir);
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX571DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX571DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX571DNG(RawConverter* rawConverter, RawImage* rawImage);
 void calibrateIMX571(RawConverter* rawConverter, const std::filesystem::path& input_dir);
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicLeicaQ2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicLeicaQ2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicLeicaQ2DNG(RawConverter* rawConverter, RawImage* rawImage);
 void calibrateLeicaQ2(RawConverter* rawConverter, const std::filesystem::path& input_dir);
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicCanonEOSRPDNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicCanonEOSRPDNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicCanonEOSRPDNG(RawConverter* rawConverter, RawImage* rawImage);
 void calibrateCanonEOSRP(RawConverter* rawConverter, const std::filesystem::path& input_dir);
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicSonya6400DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicSonya6400DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicSonya6400DNG(RawConverter* rawConverter, RawImage* rawImage);
 void calibrateSonya6400(RawConverter* rawConverter, const std::filesystem::path& input_dir);
 
 void calibrateRicohGRIII(RawConverter* rawConverter, const std::filesystem::path& input_dir);
-gls::image<gls::rgb_pixel>::unique_ptr demosaicRicohGRIII2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicRicohGRIII2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaicRicohGRIII2DNG(RawConverter* rawConverter, RawImage* rawImage);
 
 void calibrateiPhone11(RawConverter* rawConverter, const std::filesystem::path& input_dir);
-gls::image<gls::rgb_pixel>::unique_ptr demosaiciPhone11(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaiciPhone11(RawConverter* rawConverter, const std::filesystem::path& input_path);
+gls::cl_image_2d<gls::rgba_pixel>* demosaiciPhone11(RawConverter* rawConverter, RawImage* rawImage);
 
 #endif /* CameraCalibration_hpp */
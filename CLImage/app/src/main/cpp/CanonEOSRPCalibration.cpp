@@ -208,11 +208,12 @@ std::pair<float, std::array<DenoiseParameters, 5>> CanonEOSRPDenoiseParameters(i
 }
 
 gls::image<gls::rgb_pixel>::unique_ptr calibrateCanonEOSRP(RawConverter* rawConverter,
-                                                           const std::filesystem::path& input_path,
+                                                           RawImage* rawImage,
                                                            DemosaicParameters* demosaicParameters,
                                                            int iso, const gls::rectangle& gmb_position) {
-    gls::tiff_metadata dng_metadata, exif_metadata;
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, demosaicParameters, /*auto_white_balance=*/ false, &gmb_position, /*rotate_180=*/ false);
 
@@ -252,9 +253,13 @@ void calibrateCanonEOSRP(RawConverter* rawConverter, const std::filesystem::path
 
     std::array<NoiseModel, 10> noiseModel;
 
-    for (int i = 0; i < calibration_files.size(); i++) {
+    std::vector<std::filesystem::path> calibration_paths;
+    for (const auto& entry : calibration_files) {
+        calibration_paths.push_back(input_dir / entry.fileName);
+    }
+    forEachRawImage(calibration_paths, /*depth=*/ 2, [&](RawImage* rawImage, int i, ImageWriter* imageWriter) {
         auto& entry = calibration_files[i];
-        const auto input_path = input_dir / entry.fileName;
+        const auto& input_path = rawImage->path;
 
         DemosaicParameters demosaicParameters = {
             .rgbConversionParameters = {
@@ -262,11 +267,12 @@ void calibrateCanonEOSRP(RawConverter* rawConverter, const std::filesystem::path
             }
         };
 
-        const auto rgb_image = calibrateCanonEOSRP(rawConverter, input_path, &demosaicParameters, entry.iso, entry.gmb_position);
-        rgb_image->write_png_file((input_path.parent_path() / input_path.stem()).string() + "_cal_high_noise.png", /*skip_alpha=*/ true);
+        auto rgb_image = calibrateCanonEOSRP(rawConverter, rawImage, &demosaicParameters, entry.iso, entry.gmb_position);
 
         noiseModel[i] = demosaicParameters.noiseModel;
-    }
+
+        return imageWriter->writePngFile(std::move(rgb_image), (input_path.parent_path() / input_path.stem()).string() + "_cal_high_noise.png");
+    });
 
     std::cout << "Calibration table for CanonEOSRP:" << std::endl;
     for (int i = 0; i < calibration_files.size(); i++) {
@@ -278,15 +284,16 @@ void calibrateCanonEOSRP(RawConverter* rawConverter, const std::filesystem::path
     }
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicCanonEOSRPDNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+gls::cl_image_2d<gls::rgba_pixel>* demosaicCanonEOSRPDNG(RawConverter* rawConverter, RawImage* rawImage) {
     DemosaicParameters demosaicParameters = {
         .rgbConversionParameters = {
             .localToneMapping = false
         }
     };
 
-    gls::tiff_metadata dng_metadata, exif_metadata;
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, &demosaicParameters, /*auto_white_balance=*/ false, nullptr /* &gmb_position */, /*rotate_180=*/ false);
 
@@ -301,5 +308,10 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicCanonEOSRPDNG(RawConverter* rawCo
     demosaicParameters.noiseLevel = denoiseParameters.first;
     demosaicParameters.denoiseParameters = denoiseParameters.second;
 
-    return RawConverter::convertToRGBImage(*rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false));
+    return rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false);
+}
+
+gls::cl_image_2d<gls::rgba_pixel>* demosaicCanonEOSRPDNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+    const auto rawImage = RawImage::read(input_path);
+    return demosaicCanonEOSRPDNG(rawConverter, rawImage.get());
 }
@@ -148,10 +148,9 @@ std::pair<float, std::array<DenoiseParameters, 5>> IMX492DenoiseParameters(int i
     return { nlf_alpha, denoiseParameters };
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr calibrateIMX492DNG(RawConverter* rawConverter, const std::filesystem::path& input_path,
-                                                          DemosaicParameters* demosaicParameters, int iso,
-                                                          const gls::rectangle& rotated_gmb_position, bool rotate_180) {
-    gls::tiff_metadata dng_metadata, exif_metadata;
+// Calibration shots are processed with an identity color matrix and white balance
+static gls::tiff_metadata IMX492CalibrationDngDefaults() {
+    gls::tiff_metadata dng_metadata;
     dng_metadata.insert({ TIFFTAG_COLORMATRIX1, std::vector<float>{ 1, 0, 0, 0, 1, 0, 0, 0, 1 } });
     dng_metadata.insert({ TIFFTAG_ASSHOTNEUTRAL, std::vector<float>{ 1, 1, 1 } });
     dng_metadata.insert({ TIFFTAG_CFAREPEATPATTERNDIM, std::vector<uint16_t>{ 2, 2 } });
@@ -160,8 +159,17 @@ gls::image<gls::rgb_pixel>::unique_ptr calibrateIMX492DNG(RawConverter* rawConve
     dng_metadata.insert({ TIFFTAG_WHITELEVEL, std::vector<uint32_t>{ 0xfff } });
     dng_metadata.insert({ TIFFTAG_MAKE, "Glass Imaging" });
     dng_metadata.insert({ TIFFTAG_UNIQUECAMERAMODEL, "Glass 1" });
+    return dng_metadata;
+}
+
+// rawImage is read with IMX492CalibrationDngDefaults()
+gls::image<gls::rgb_pixel>::unique_ptr calibrateIMX492DNG(RawConverter* rawConverter, RawImage* rawImage,
+                                                          DemosaicParameters* demosaicParameters, int iso,
+                                                          const gls::rectangle& rotated_gmb_position, bool rotate_180) {
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
 
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    const auto& inputImage = rawImage->image;
 
     const gls::rectangle gmb_position = rotate180(rotated_gmb_position, *inputImage);
 
@@ -199,9 +207,13 @@ void calibrateIMX492(RawConverter* rawConverter, const std::filesystem::path& in
 
     std::array<NoiseModel, 6> noiseModel;
 
-    for (int i = 0; i < calibration_files.size(); i++) {
+    std::vector<std::filesystem::path> calibration_paths;
+    for (const auto& entry : calibration_files) {
+        calibration_paths.push_back(input_dir / entry.fileName);
+    }
+    forEachRawImage(calibration_paths, /*depth=*/ 2, [&](RawImage* rawImage, int i, ImageWriter* imageWriter) {
         auto& entry = calibration_files[i];
-        const auto input_path = input_dir / entry.fileName;
+        const auto& input_path = rawImage->path;
 
         DemosaicParameters demosaicParameters = {
             .rgbConversionParameters = {
@@ -211,11 +223,12 @@ void calibrateIMX492(RawConverter* rawConverter, const std::filesystem::path& in
             }
         };
 
-        const auto rgb_image = calibrateIMX492DNG(rawConverter, input_path, &demosaicParameters, entry.iso, entry.gmb_position, entry.rotated);
-        rgb_image->write_png_file((input_path.parent_path() / input_path.stem()).string() + "_cal_rgb.png", /*skip_alpha=*/ true);
+        auto rgb_image = calibrateIMX492DNG(rawConverter, rawImage, &demosaicParameters, entry.iso, entry.gmb_position, entry.rotated);
 
         noiseModel[i] = demosaicParameters.noiseModel;
-    }
+
+        return imageWriter->writePngFile(std::move(rgb_image), (input_path.parent_path() / input_path.stem()).string() + "_cal_rgb.png");
+    }, IMX492CalibrationDngDefaults());
 
     std::cout << "Calibration table for IMX492:" << std::endl;
     for (int i = 0; i < calibration_files.size(); i++) {
@@ -227,16 +240,8 @@ void calibrateIMX492(RawConverter* rawConverter, const std::filesystem::path& in
     }
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX492DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
-    DemosaicParameters demosaicParameters = {
-        .rgbConversionParameters = {
-            .contrast = 1.05,
-            .saturation = 1.0,
-            .toneCurveSlope = 3.5,
-        }
-    };
-
-    gls::tiff_metadata dng_metadata, exif_metadata;
+gls::tiff_metadata IMX492DngDefaults() {
+    gls::tiff_metadata dng_metadata;
     // Leaky IR
 //    dng_metadata.insert({ TIFFTAG_COLORMATRIX1, std::vector<float>{ 1.4955, -0.6760, -0.1453, -0.1341, 1.0072, 0.1269, -0.0647, 0.1987, 0.4304 } });
 //    dng_metadata.insert({ TIFFTAG_ASSHOTNEUTRAL, std::vector<float>{ 1 / 1.73344, 1, 1 / 1.68018 } });
@@ -255,8 +260,23 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX492DNG(RawConverter* rawConver
     dng_metadata.insert({ TIFFTAG_WHITELEVEL, std::vector<uint32_t>{ 0xfff } });
     dng_metadata.insert({ TIFFTAG_MAKE, "Glass Imaging" });
     dng_metadata.insert({ TIFFTAG_UNIQUECAMERAMODEL, "Glass 1" });
+    return dng_metadata;
+}
 
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+// rawImage is read with IMX492DngDefaults()
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX492DNG(RawConverter* rawConverter, RawImage* rawImage) {
+    DemosaicParameters demosaicParameters = {
+        .rgbConversionParameters = {
+            .contrast = 1.05,
+            .saturation = 1.0,
+            .toneCurveSlope = 3.5,
+        }
+    };
+
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
+
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, &demosaicParameters, /*auto_white_balance=*/ false, /*gmb_position=*/ nullptr, /*rotate_180=*/ true);
 
@@ -273,6 +293,12 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX492DNG(RawConverter* rawConver
     demosaicParameters.noiseLevel = denoiseParameters.first;
     demosaicParameters.denoiseParameters = denoiseParameters.second;
 
-    return RawConverter::convertToRGBImage(*rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr, /*rotate_180=*/ true));
+    return rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr, /*rotate_180=*/ true);
     // return RawConverter::convertToRGBImage(*rawConverter->fastDemosaicImage(*inputImage, demosaicParameters));
 }
+
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX492DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+    const auto dng_defaults = IMX492DngDefaults();
+    const auto rawImage = RawImage::read(input_path, &dng_defaults);
+    return demosaicIMX492DNG(rawConverter, rawImage.get());
+}
@@ -210,17 +210,24 @@ void rotate180AndFlipHorizontal(gls::image<gls::luma_pixel_16>* inputImage) {
     }
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr calibrateIMX571DNG(RawConverter* rawConverter, const std::filesystem::path& input_path,
-                                                          DemosaicParameters* demosaicParameters, int iso,
-                                                          const gls::rectangle& gmb_position, bool rotate_180) {
-    gls::tiff_metadata dng_metadata, exif_metadata;
+gls::tiff_metadata IMX571DngDefaults() {
+    gls::tiff_metadata dng_metadata;
+    dng_metadata.insert({ TIFFTAG_COLORMATRIX1, std::vector<float>{ 1.2594, -0.5333, -0.1138, -0.1404, 0.9717, 0.1688, 0.0342, 0.0969, 0.4330 } });
+    dng_metadata.insert({ TIFFTAG_ASSHOTNEUTRAL, std::vector<float>{ 1 / 1.8930, 1.0000, 1 / 1.7007 } });
+
     dng_metadata.insert({ TIFFTAG_MAKE, "Glass Imaging" });
     dng_metadata.insert({ TIFFTAG_UNIQUECAMERAMODEL, "Glass 2" });
+    return dng_metadata;
+}
 
-    dng_metadata.insert({ TIFFTAG_COLORMATRIX1, std::vector<float>{ 1.2594, -0.5333, -0.1138, -0.1404, 0.9717, 0.1688, 0.0342, 0.0969, 0.4330 } });
-    dng_metadata.insert({ TIFFTAG_ASSHOTNEUTRAL, std::vector<float>{ 1 / 1.8930, 1.0000, 1 / 1.7007 } });
+// rawImage is read with IMX571DngDefaults()
+gls::image<gls::rgb_pixel>::unique_ptr calibrateIMX571DNG(RawConverter* rawConverter, RawImage* rawImage,
+                                                          DemosaicParameters* demosaicParameters, int iso,
+                                                          const gls::rectangle& gmb_position, bool rotate_180) {
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
 
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, demosaicParameters, /*auto_white_balance=*/ false, &gmb_position, rotate_180);
 
@@ -257,9 +264,13 @@ void calibrateIMX571(RawConverter* rawConverter, const std::filesystem::path& in
 
     std::array<NoiseModel, 8> noiseModel;
 
-    for (int i = 0; i < calibration_files.size(); i++) {
+    std::vector<std::filesystem::path> calibration_paths;
+    for (const auto& entry : calibration_files) {
+        calibration_paths.push_back(input_dir / entry.fileName);
+    }
+    forEachRawImage(calibration_paths, /*depth=*/ 2, [&](RawImage* rawImage, int i, ImageWriter* imageWriter) {
         auto& entry = calibration_files[i];
-        const auto input_path = input_dir / entry.fileName;
+        const auto& input_path = rawImage->path;
 
         DemosaicParameters demosaicParameters = {
             .rgbConversionParameters = {
@@ -269,11 +280,12 @@ void calibrateIMX571(RawConverter* rawConverter, const std::filesystem::path& in
             }
         };
 
-        const auto rgb_image = calibrateIMX571DNG(rawConverter, input_path, &demosaicParameters, entry.iso, entry.gmb_position, entry.rotated);
-        rgb_image->write_png_file((input_path.parent_path() / input_path.stem()).string() + "_cal_rgb.png", /*skip_alpha=*/ true);
+        auto rgb_image = calibrateIMX571DNG(rawConverter, rawImage, &demosaicParameters, entry.iso, entry.gmb_position, entry.rotated);
 
         noiseModel[i] = demosaicParameters.noiseModel;
-    }
+
+        return imageWriter->writePngFile(std::move(rgb_image), (input_path.parent_path() / input_path.stem()).string() + "_cal_rgb.png");
+    }, IMX571DngDefaults());
 
     std::cout << "Calibration table for IMX571:" << std::endl;
     for (int i = 0; i < calibration_files.size(); i++) {
@@ -285,7 +297,8 @@ void calibrateIMX571(RawConverter* rawConverter, const std::filesystem::path& in
     }
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX571DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+// rawImage is read with IMX571DngDefaults()
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX571DNG(RawConverter* rawConverter, RawImage* rawImage) {
     DemosaicParameters demosaicParameters = {
         .rgbConversionParameters = {
             .contrast = 1.0,
@@ -304,14 +317,10 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX571DNG(RawConverter* rawConver
         }
     };
 
-    gls::tiff_metadata dng_metadata, exif_metadata;
-    dng_metadata.insert({ TIFFTAG_COLORMATRIX1, std::vector<float>{ 1.2594, -0.5333, -0.1138, -0.1404, 0.9717, 0.1688, 0.0342, 0.0969, 0.4330 } });
-    dng_metadata.insert({ TIFFTAG_ASSHOTNEUTRAL, std::vector<float>{ 1 / 1.8930, 1.0000, 1 / 1.7007 } });
-
-    dng_metadata.insert({ TIFFTAG_MAKE, "Glass Imaging" });
-    dng_metadata.insert({ TIFFTAG_UNIQUECAMERAMODEL, "Glass 2" });
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
 
-    auto fullInputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    const auto& fullInputImage = rawImage->image;
 
     // A crop size with dimensions multiples of 128 and ratio of exactly 3:2, for a total resolution of 16MP
     const gls::size imageSize = { 4992, 3328 };
@@ -346,6 +355,12 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicIMX571DNG(RawConverter* rawConver
 //        std::cout << "exposureBias: " << -exposureCompensation << std::endl;
 //    }
 
-    return RawConverter::convertToRGBImage(*rawConverter->demosaicImage(inputImage, &demosaicParameters, nullptr, /*rotate_180=*/ false));
+    return rawConverter->demosaicImage(inputImage, &demosaicParameters, nullptr, /*rotate_180=*/ false);
     // return RawConverter::convertToRGBImage(*rawConverter->fastDemosaicImage(inputImage, demosaicParameters));
 }
+
+gls::cl_image_2d<gls::rgba_pixel>* demosaicIMX571DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+    const auto dng_defaults = IMX571DngDefaults();
+    const auto rawImage = RawImage::read(input_path, &dng_defaults);
+    return demosaicIMX571DNG(rawConverter, rawImage.get());
+}
@@ -208,11 +208,12 @@ std::pair<float, std::array<DenoiseParameters, 5>> LeicaQ2DenoiseParameters(int
 }
 
 gls::image<gls::rgb_pixel>::unique_ptr calibrateLeicaQ2(RawConverter* rawConverter,
-                                                        const std::filesystem::path& input_path,
+                                                        RawImage* rawImage,
                                                         DemosaicParameters* demosaicParameters,
                                                         int iso, const gls::rectangle& gmb_position) {
-    gls::tiff_metadata dng_metadata, exif_metadata;
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, demosaicParameters, /*auto_white_balance=*/ false, &gmb_position, /*rotate_180=*/ false);
 
@@ -252,9 +253,13 @@ void calibrateLeicaQ2(RawConverter* rawConverter, const std::filesystem::path& i
 
     std::array<NoiseModel, 10> noiseModel;
 
-    for (int i = 0; i < calibration_files.size(); i++) {
+    std::vector<std::filesystem::path> calibration_paths;
+    for (const auto& entry : calibration_files) {
+        calibration_paths.push_back(input_dir / entry.fileName);
+    }
+    forEachRawImage(calibration_paths, /*depth=*/ 2, [&](RawImage* rawImage, int i, ImageWriter* imageWriter) {
         auto& entry = calibration_files[i];
-        const auto input_path = input_dir / entry.fileName;
+        const auto& input_path = rawImage->path;
 
         DemosaicParameters demosaicParameters = {
             .rgbConversionParameters = {
@@ -264,11 +269,12 @@ void calibrateLeicaQ2(RawConverter* rawConverter, const std::filesystem::path& i
             }
         };
 
-        const auto rgb_image = calibrateLeicaQ2(rawConverter, input_path, &demosaicParameters, entry.iso, entry.gmb_position);
-        rgb_image->write_png_file((input_path.parent_path() / input_path.stem()).string() + "_cal_new_full_v1.png", /*skip_alpha=*/ true);
+        auto rgb_image = calibrateLeicaQ2(rawConverter, rawImage, &demosaicParameters, entry.iso, entry.gmb_position);
 
         noiseModel[i] = demosaicParameters.noiseModel;
-    }
+
+        return imageWriter->writePngFile(std::move(rgb_image), (input_path.parent_path() / input_path.stem()).string() + "_cal_new_full_v1.png");
+    });
 
     std::cout << "Calibration table for LeicaQ2:" << std::endl;
     for (int i = 0; i < calibration_files.size(); i++) {
@@ -280,7 +286,7 @@ void calibrateLeicaQ2(RawConverter* rawConverter, const std::filesystem::path& i
     }
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicLeicaQ2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+gls::cl_image_2d<gls::rgba_pixel>* demosaicLeicaQ2DNG(RawConverter* rawConverter, RawImage* rawImage) {
     DemosaicParameters demosaicParameters = {
         .rgbConversionParameters = {
             .contrast = 1.05,
@@ -289,8 +295,9 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicLeicaQ2DNG(RawConverter* rawConve
         }
     };
 
-    gls::tiff_metadata dng_metadata, exif_metadata;
-    const auto inputImage = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata, &exif_metadata);
+    auto& dng_metadata = rawImage->dng_metadata;
+    auto& exif_metadata = rawImage->exif_metadata;
+    const auto& inputImage = rawImage->image;
 
     unpackDNGMetadata(*inputImage, &dng_metadata, &demosaicParameters, /*auto_white_balance=*/ false, nullptr /* &gmb_position */, /*rotate_180=*/ false);
 
@@ -305,5 +312,10 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicLeicaQ2DNG(RawConverter* rawConve
     demosaicParameters.noiseLevel = denoiseParameters.first;
     demosaicParameters.denoiseParameters = denoiseParameters.second;
 
-    return RawConverter::convertToRGBImage(*rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false));
+    return rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false);
+}
+
+gls::cl_image_2d<gls::rgba_pixel>* demosaicLeicaQ2DNG(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+    const auto rawImage = RawImage::read(input_path);
+    return demosaicLeicaQ2DNG(rawConverter, rawImage.get());
 }
@@ -32,6 +32,9 @@ float3 boxBlur(image2d_t blurMap, int2 imageCoordinates) {
 
 kernel void blur(read_only image2d_t input, write_only image2d_t output) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(output))) {
+        return;
+    }
     float3 result = boxBlur(input, imageCoordinates);
     write_imagef(output, imageCoordinates, (float4) (result, 1));
 }
@@ -70,6 +70,9 @@ kernel void scaleRawData(read_only image2d_t rawImage, write_only image2d_t scal
                          int bayerPattern, float4 vScaleMul, float blackLevel) {
     float *scaleMul = (float *) &vScaleMul;
     const int2 imageCoordinates = (int2) (2 * get_global_id(0), 2 * get_global_id(1));
+    if (any(imageCoordinates + 1 >= get_image_dim(scaledRawImage))) {
+        return;
+    }
     for (int c = 0; c < 4; c++) {
         int2 o = bayerOffsets[bayerPattern][c];
         write_imagef(scaledRawImage, imageCoordinates + (int2) (o.x, o.y),
@@ -162,6 +165,9 @@ kernel void interpolateGreen(read_only image2d_t rawImage, write_only image2d_t
     lumaVariance = max(lumaVariance, 1e-4);
 
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(greenImage))) {
+        return;
+    }
 
     const int x = imageCoordinates.x;
     const int y = imageCoordinates.y;
@@ -233,6 +239,9 @@ kernel void interpolateRedBlue(read_only image2d_t rawImage, read_only image2d_t
     chromaVariance = max(chromaVariance, 1e-6);
 
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(rgbImage))) {
+        return;
+    }
 
     const int x = imageCoordinates.x;
     const int y = imageCoordinates.y;
@@ -319,6 +328,9 @@ kernel void interpolateRedBlue(read_only image2d_t rawImage, read_only image2d_t
 
 kernel void fastDebayer(read_only image2d_t rawImage, write_only image2d_t rgbImage, int bayerPattern) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(rgbImage))) {
+        return;
+    }
 
     const int2 r = bayerOffsets[bayerPattern][raw_red];
     const int2 g = bayerOffsets[bayerPattern][raw_green];
@@ -348,6 +360,9 @@ kernel void blendHighlightsImage(read_only image2d_t inputImage, float clip, wri
     };
 
     const int2 imageCoordinates = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     float3 pixel = read_imagef(inputImage, imageCoordinates).xyz;
     if (any(pixel > clip)) {
@@ -416,6 +431,9 @@ kernel void blendHighlightsImage(read_only image2d_t inputImage, float clip, wri
 
 kernel void medianFilterImage3x3(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     typedef half3 medianPixelType;
 
@@ -430,6 +448,9 @@ kernel void medianFilterImage3x3(read_only image2d_t inputImage, write_only imag
 
 kernel void medianFilterImage3x3x4(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     typedef half4 medianPixelType;
 
@@ -462,6 +483,9 @@ kernel void medianFilterImage3x3x4(read_only image2d_t inputImage, write_only im
 
 kernel void despeckleLumaMedianChromaImage(read_only image2d_t inputImage, float3 var_a, float3 var_b, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     typedef half2 medianPixelType;
     half sample = 0, firstMax = 0, secMax = 0;
@@ -519,6 +543,9 @@ float despeckle_3x3(image2d_t inputImage, float inputLuma, float var_a, float va
 
 kernel void despeckleImage(read_only image2d_t inputImage, float3 var_a, float3 var_b, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     float3 inputPixel = read_imagef(inputImage, imageCoordinates).xyz;
 
@@ -624,6 +651,9 @@ float4 despeckle_3x3x4(image2d_t inputImage, int2 imageCoordinates) {
 
 kernel void medianFilterImage5x5x3(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     typedef half3 medianPixelType;
 
@@ -638,6 +668,9 @@ kernel void medianFilterImage5x5x3(read_only image2d_t inputImage, write_only im
 
 kernel void medianFilterImage5x5x4(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     typedef half4 medianPixelType;
 
@@ -674,6 +707,9 @@ kernel void medianFilterImage5x5x4(read_only image2d_t inputImage, write_only im
 
 kernel void falseColorsRemovalImage(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     half3 inputPixel = read_imageh(inputImage, imageCoordinates).xyz;
 
@@ -727,6 +763,9 @@ typedef struct {
 
 kernel void transformImage(read_only image2d_t inputImage, write_only image2d_t outputImage, Matrix3x3 transform) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
     float3 inputValue = read_imagef(inputImage, imageCoordinates).xyz;
     float3 outputPixel = (float3) (dot(transform.m[0], inputValue), dot(transform.m[1], inputValue), dot(transform.m[2], inputValue));
     write_imagef(outputImage, imageCoordinates, (float4) (outputPixel, 0.0));
@@ -734,6 +773,9 @@ kernel void transformImage(read_only image2d_t inputImage, write_only image2d_t
 
 kernel void denoiseImage(read_only image2d_t inputImage, float3 var_a, float3 var_b, float chromaBoost, float gradientBoost, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     const float3 inputYCC = read_imagef(inputImage, imageCoordinates).xyz;
 
@@ -844,6 +886,9 @@ float3 denoiseLumaChromaGuided(float3 var_a, float3 var_b, image2d_t inputImage,
 
 kernel void denoiseImageGuided(read_only image2d_t inputImage, float3 var_a, float3 var_b, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     float3 denoisedPixel = denoiseLumaChromaGuided(var_a, var_b, inputImage, imageCoordinates);
 
@@ -852,6 +897,9 @@ kernel void denoiseImageGuided(read_only image2d_t inputImage, float3 var_a, flo
 
 kernel void downsampleImage(read_only image2d_t inputImage, write_only image2d_t outputImage, sampler_t linear_sampler) {
     const int2 output_pos = (int2) (get_global_id(0), get_global_id(1));
+    if (any(output_pos >= get_image_dim(outputImage))) {
+        return;
+    }
     const float2 input_norm = 1.0 / convert_float2(get_image_dim(outputImage));
     const float2 input_pos = (convert_float2(output_pos) + 0.5) * input_norm;
 
@@ -868,6 +916,9 @@ kernel void reassembleImage(read_only image2d_t inputImageDenoised0, read_only i
                             read_only image2d_t inputImageDenoised1, float sharpening, float2 nlf,
                             write_only image2d_t outputImage, sampler_t linear_sampler) {
     const int2 output_pos = (int2) (get_global_id(0), get_global_id(1));
+    if (any(output_pos >= get_image_dim(outputImage))) {
+        return;
+    }
     const float2 inputNorm = 1.0 / convert_float2(get_image_dim(outputImage));
     const float2 input_pos = (convert_float2(output_pos) + 0.5) * inputNorm;
 
@@ -897,6 +948,9 @@ kernel void reassembleImage(read_only image2d_t inputImageDenoised0, read_only i
 
 kernel void bayerToRawRGBA(read_only image2d_t rawImage, write_only image2d_t rgbaImage, int bayerPattern) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(rgbaImage))) {
+        return;
+    }
 
     const int2 r = bayerOffsets[bayerPattern][raw_red];
     const int2 g = bayerOffsets[bayerPattern][raw_green];
@@ -913,6 +967,9 @@ kernel void bayerToRawRGBA(read_only image2d_t rawImage, write_only image2d_t rg
 
 kernel void rawRGBAToBayer(read_only image2d_t rgbaImage, write_only image2d_t rawImage, int bayerPattern) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(rgbaImage))) {
+        return;
+    }
 
     float4 rgba = read_imagef(rgbaImage, imageCoordinates);
 
@@ -987,6 +1044,9 @@ float4 denoiseRawRGBAGuided(float4 rawVariance, image2d_t inputImage, int2 image
 
 kernel void guidedFilterAB(read_only image2d_t pImage, read_only image2d_t I_Image, float eps, write_only image2d_t abImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(abImage))) {
+        return;
+    }
 
     const int radius = 5;
     const int count = (2 * radius + 1) * (2 * radius + 1);
@@ -1099,6 +1159,9 @@ float4 localToneMappingMask(LTMParameters *ltmParameters, Matrix3x3* ycbcr_srgb,
 kernel void localToneMappingMaskImage(read_only image2d_t inputImage, read_only image2d_t guideImage, LTMParameters ltmParameters,
                                       Matrix3x3 ycbcr_srgb, write_only image2d_t outputImage, sampler_t linear_sampler) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
     const float2 inputNorm = 1.0 / convert_float2(get_image_dim(outputImage));
 
     float4 denoisedPixel = localToneMappingMask(&ltmParameters, &ycbcr_srgb, inputImage, guideImage, imageCoordinates, linear_sampler, inputNorm);
@@ -1186,6 +1249,9 @@ float4 denoiseRawRGBAGuidedCov(float4 eps, image2d_t inputImage, int2 imageCoord
 
 kernel void denoiseRawRGBAImage(read_only image2d_t inputImage, float4 rawVariance, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     float4 denoisedPixel = denoiseRawRGBA(rawVariance, inputImage, imageCoordinates);
 
@@ -1194,6 +1260,9 @@ kernel void denoiseRawRGBAImage(read_only image2d_t inputImage, float4 rawVarian
 
 kernel void despeckleRawRGBAImage(read_only image2d_t inputImage, write_only image2d_t denoisedImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(denoisedImage))) {
+        return;
+    }
 
     float4 despeckledPixel = despeckle_3x3x4(inputImage, imageCoordinates);
 
@@ -1202,6 +1271,9 @@ kernel void despeckleRawRGBAImage(read_only image2d_t inputImage, write_only ima
 
 kernel void sobelFilterImage(read_only image2d_t inputImage, write_only image2d_t outputImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     constant float sobelX[3][3] = {
         { -1, -2, -1 },
@@ -1229,6 +1301,9 @@ kernel void sobelFilterImage(read_only image2d_t inputImage, write_only image2d_
 
 kernel void desaturateEdges(read_only image2d_t inputImage, write_only image2d_t outputImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     float d2x = read_imagef(inputImage, imageCoordinates + (int2)(-1, 0)).x -
                 2 * read_imagef(inputImage, imageCoordinates + (int2)(0, 0)).x +
@@ -1246,6 +1321,9 @@ kernel void desaturateEdges(read_only image2d_t inputImage, write_only image2d_t
 
 kernel void laplacianFilterImage(read_only image2d_t inputImage, write_only image2d_t outputImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     constant float laplacian[3][3] = {
         {  1, -2,  1 },
@@ -1266,6 +1344,9 @@ kernel void laplacianFilterImage(read_only image2d_t inputImage, write_only imag
 
 kernel void noiseStatistics(read_only image2d_t inputImage, write_only image2d_t outputImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     int radius = 2;
     int count = (2 * radius + 1) * (2 * radius + 1);
@@ -1301,6 +1382,9 @@ float4 readRAWQuad(read_only image2d_t rawImage, int2 imageCoordinates, constant
 
 kernel void rawNoiseStatistics(read_only image2d_t inputImage, int bayerPattern, write_only image2d_t meanImage, write_only image2d_t varImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(meanImage))) {
+        return;
+    }
 
     constant const int2* offsets = bayerOffsets[bayerPattern];
 
@@ -1342,6 +1426,9 @@ float3 gaussianBlur(float radius, image2d_t inputImage, int2 imageCoordinates) {
 
 kernel void gaussianBlurImage(read_only image2d_t inputImage, float radius, write_only image2d_t outputImage) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
 
     float3 value = gaussianBlur(radius, inputImage, imageCoordinates);
 
@@ -1350,6 +1437,9 @@ kernel void gaussianBlurImage(read_only image2d_t inputImage, float radius, writ
 
 kernel void sampledConvolution(read_only image2d_t inputImage, int samples, constant float weights[][3], write_only image2d_t outputImage, sampler_t linear_sampler) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
     const float2 inputNorm = 1.0 / convert_float2(get_image_dim(outputImage));
 
     const float2 inputPos = convert_float2(imageCoordinates) * inputNorm;
@@ -1432,6 +1522,9 @@ typedef struct RGBConversionParameters {
 kernel void convertTosRGB(read_only image2d_t linearImage, read_only image2d_t ltmMaskImage, write_only image2d_t rgbImage,
                           Matrix3x3 transform, RGBConversionParameters parameters) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(rgbImage))) {
+        return;
+    }
 
     float3 pixel_value = read_imagef(linearImage, imageCoordinates).xyz;
 
@@ -1475,6 +1568,9 @@ kernel void convertTosRGB(read_only image2d_t linearImage, read_only image2d_t l
 
 kernel void resample(read_only image2d_t inputImage, write_only image2d_t outputImage, sampler_t linear_sampler) {
     const int2 imageCoordinates = (int2) (get_global_id(0), get_global_id(1));
+    if (any(imageCoordinates >= get_image_dim(outputImage))) {
+        return;
+    }
     const float2 inputNorm = 1.0 / convert_float2(get_image_dim(outputImage));
 
     float3 outputPixel = read_imagef(inputImage, linear_sampler, convert_float2(imageCoordinates) * inputNorm + 0.5 * inputNorm).xyz;
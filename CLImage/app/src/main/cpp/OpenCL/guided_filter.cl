@@ -17,6 +17,9 @@ kernel void boxBlurX(read_only image2d_t inputImage,
                      int filterSize,
                      write_only image2d_t outputImage) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(inputImage))) {
+        return;
+    }
 
     float4 sum = 0;
     for (int x = -filterSize / 2; x <= filterSize / 2; x++) {
@@ -31,6 +34,9 @@ kernel void covMatrixProducts(read_only image2d_t inputImage,
                               write_only image2d_t products1,
                               write_only image2d_t products2) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(inputImage))) {
+        return;
+    }
 
     float3 sample = read_imagef(inputImage, imageCoordinate).xyz;
 
@@ -50,6 +56,9 @@ kernel void invSigma(read_only image2d_t meanImage,
                      write_only image2d_t invSigma1Image,
                      write_only image2d_t invSigma2Image) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(meanImage))) {
+        return;
+    }
 
     float3 mean_I = read_imagef(meanImage, imageCoordinate).xyz;
     float4 products1 = read_imagef(products1Image, imageCoordinate);
@@ -87,6 +96,9 @@ kernel void meanIpProducts(read_only image2d_t inputImage,
                            write_only image2d_t mean_Ip_g,
                            write_only image2d_t mean_Ip_b) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(inputImage))) {
+        return;
+    }
 
     float3 p = read_imagef(inputImage, imageCoordinate).xyz;
     write_imagef(mean_Ip_r, imageCoordinate, (float4)(p.x * p, 0));
@@ -104,6 +116,9 @@ kernel void computeAb(read_only image2d_t mean_pImage,
                       write_only image2d_t ab_gImage,
                       write_only image2d_t ab_bImage) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(mean_pImage))) {
+        return;
+    }
 
     float3 mean_p = read_imagef(mean_pImage, imageCoordinate).xyz;
     float3 mean_I = mean_p;
@@ -142,6 +157,9 @@ kernel void computeResult(read_only image2d_t inputImage,
                           read_only image2d_t ab_bImage,
                           write_only image2d_t resultImage) {
     const int2 imageCoordinate = (int2)(get_global_id(0), get_global_id(1));
+    if (any(imageCoordinate >= get_image_dim(inputImage))) {
+        return;
+    }
 
     float3 input = read_imagef(inputImage, imageCoordinate).xyz;
     float4 ab_r = read_imagef(ab_rImage, imageCoordinate);
@@ -0,0 +1,145 @@
+/*******************************************************************************
+ * Copyright (c) 2021-2022 Glass Imaging Inc.
+ * Author: Fabio Riccardi <fabio@glass-imaging.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ ******************************************************************************/
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+#include "gls_dng_lossless_jpeg.hpp"
+#include "gls_image.hpp"
+#include "gls_tiff_metadata.hpp"
+
+// Converts raw files between DNG and the glsraw cache format, and benchmarks glsraw decoding against lossless JPEG
+
+static void convertToGlsRaw(const std::filesystem::path& input_path, const std::filesystem::path& output_path) {
+    gls::tiff_metadata dng_metadata, exif_metadata;
+    const auto image = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata,
+                                                                     &exif_metadata);
+    image->write_glsraw_file(output_path.string(), &dng_metadata, &exif_metadata);
+    std::cout << "Wrote " << output_path << " (" << std::filesystem::file_size(output_path) << " bytes)" << std::endl;
+}
+
+static void convertToDNG(const std::filesystem::path& input_path, const std::filesystem::path& output_path) {
+    gls::tiff_metadata dng_metadata, exif_metadata;
+    const auto image = gls::image<gls::luma_pixel_16>::read_glsraw_file(input_path.string(), &dng_metadata,
+                                                                        &exif_metadata);
+    image->write_dng_file(output_path.string(), /*compression=*/ gls::JPEG, &dng_metadata, &exif_metadata);
+    std::cout << "Wrote " << output_path << " (" << std::filesystem::file_size(output_path) << " bytes)" << std::endl;
+}
+
+// Best time in milliseconds of a few runs
+template <typename F>
+static double timeRuns(F function, int runs = 5) {
+    double best = 0;
+    for (int i = 0; i < runs; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        best = i == 0 ? elapsed.count() : std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+// In memory decoding of the same raw data as lossless JPEG (as written by write_dng_file) and as glsraw
+static void benchmark(const std::filesystem::path& input_path) {
+    gls::tiff_metadata dng_metadata;
+    const auto image = gls::image<gls::luma_pixel_16>::read_dng_file(input_path.string(), &dng_metadata);
+    const int width = image->width;
+    const int height = image->height;
+
+    std::vector<uint16_t> samples((size_t) width * height);
+    for (int y = 0; y < height; y++) {
+        memcpy(samples.data() + (size_t) y * width, (*image)[y], width * sizeof(uint16_t));
+    }
+    const auto white_level = gls::getVector<uint32_t>(dng_metadata, TIFFTAG_WHITELEVEL);
+    const int bit_depth = std::max(white_level.empty() ? 16 : (int) std::bit_width(white_level[0]),
+                                   (int) std::bit_width(*std::max_element(samples.begin(), samples.end())));
+
+    std::vector<uint8_t> ljpeg(samples.size() * sizeof(uint16_t) * 2);
+    gls::dng_stream output_stream(ljpeg.data(), ljpeg.size());
+    gls::EncodeLosslessJPEG(samples.data(), height, width, /*srcChannels=*/ 1, bit_depth, /*srcRowStep=*/ width,
+                            /*srcColStep=*/ 1, output_stream);
+    const size_t ljpeg_size = output_stream.Position();
+
+    const auto row_pointer = [&](int row) -> uint16_t* { return samples.data() + (size_t) row * width; };
+    const auto glsraw = gls::encode_glsraw(width, height, nullptr, nullptr, row_pointer);
+
+    const size_t decoded_size = samples.size() * sizeof(uint16_t);
+    const double ljpeg_time = timeRuns([&]() {
+        gls::dng_stream input_stream(ljpeg.data(), ljpeg.size());
+        gls::dng_spooler spooler;
+        gls::DecodeLosslessJPEG(input_stream, spooler, (uint32_t) decoded_size, (uint32_t) decoded_size, false,
+                                ljpeg_size);
+    });
+
+    std::vector<uint16_t> decoded(samples.size());
+    const auto decode_glsraw = [&](int threads) {
+        gls::decode_glsraw(
+            glsraw.data(), glsraw.size(), nullptr, nullptr, [](int, int) { return true; },
+            [&](int row) -> uint16_t* { return decoded.data() + (size_t) row * width; }, threads);
+    };
+    const double glsraw_time = timeRuns([&]() { decode_glsraw(1); });
+    const double glsraw_parallel_time = timeRuns([&]() { decode_glsraw(0); });
+    if (decoded != samples) {
+        throw std::runtime_error("glsraw decoding mismatch.");
+    }
+
+    const double megapixels = samples.size() / 1e6;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << input_path.filename() << ": " << width << "x" << height << ", " << bit_depth << " bits" << std::endl;
+    std::cout << "  LJ92:   " << ljpeg_size << " bytes, decode " << ljpeg_time << " ms ("
+              << megapixels / ljpeg_time * 1000 << " MP/s)" << std::endl;
+    std::cout << "  glsraw: " << glsraw.size() << " bytes, decode " << glsraw_time << " ms ("
+              << megapixels / glsraw_time * 1000 << " MP/s), " << glsraw_parallel_time << " ms on all cores ("
+              << megapixels / glsraw_parallel_time * 1000 << " MP/s)" << std::endl;
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 2 || strcmp(argv[1], "-help") == 0) {
+        std::cout << "Raw cache converter." << std::endl;
+        std::cout << "Usage: " << argv[0] << " input.dng [output.glsraw]" << std::endl;
+        std::cout << "       " << argv[0] << " input.glsraw [output.dng]" << std::endl;
+        std::cout << "       " << argv[0] << " -benchmark input.dng..." << std::endl;
+        return 0;
+    }
+
+    try {
+        if (strcmp(argv[1], "-benchmark") == 0) {
+            for (int i = 2; i < argc; i++) {
+                benchmark(argv[i]);
+            }
+            return 0;
+        }
+
+        const auto input_path = std::filesystem::path(argv[1]);
+        const bool to_dng = input_path.extension() == ".glsraw";
+        const auto output_path = argc > 2 ? std::filesystem::path(argv[2])
+                                          : std::filesystem::path(input_path).replace_extension(to_dng ? ".dng" : ".glsraw");
+        if (to_dng) {
+            convertToDNG(input_path, output_path);
+        } else {
+            convertToGlsRaw(input_path, output_path);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
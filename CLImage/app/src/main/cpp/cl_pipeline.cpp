@@ -22,16 +22,13 @@ static const char* TAG = "CLImage Pipeline";
 // Simple image processing with opencl.hpp, using cl_image to pass data to and from the GPU
 int blur(gls::OpenCLContext* glsContext, const gls::cl_image_2d<gls::rgba_pixel>& input, gls::cl_image_2d<gls::rgba_pixel>* output) {
     try {
-        // Load the shader source
-        const auto blurProgram = glsContext->loadProgram("blur");
-
         // Bind the kernel parameters
-        auto blurKernel = cl::KernelFunctor<cl::Image2D,  // input
-                                            cl::Image2D   // output
-                                            >(blurProgram, "blur");
+        auto blurKernel = glsContext->loadKernelFunctor<cl::Image2D,  // input
+                                                        cl::Image2D   // output
+                                                        >("blur", "blur");
 
         // Schedule the kernel on the GPU
-        blurKernel(gls::OpenCLContext::buildEnqueueArgs(output->width, output->height), input.getImage2D(), output->getImage2D());
+        glsContext->enqueue(blurKernel, output->width, output->height, input.getImage2D(), output->getImage2D());
         return 0;
     } catch (cl::Error& err) {
         LOG_ERROR(TAG) << "Caught Exception: " << std::string(err.what()) << " - " << gls::clStatusToString(err.err())
@@ -16,6 +16,9 @@
 #ifndef demosaic_hpp
 #define demosaic_hpp
 
+#include <cmath>
+#include <cstring>
+
 #include "gls_image.hpp"
 #include "gls_tiff_metadata.hpp"
 #include "gls_linalg.hpp"
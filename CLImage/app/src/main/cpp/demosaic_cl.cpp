@@ -27,39 +27,33 @@ void scaleRawData(gls::OpenCLContext* glsContext,
                  const gls::cl_image_2d<gls::luma_pixel_16>& rawImage,
                  gls::cl_image_2d<gls::luma_pixel_float>* scaledRawImage,
                  BayerPattern bayerPattern, gls::Vector<4> scaleMul, float blackLevel) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    cl::Image2D,  // scaledRawImage
-                                    int,          // bayerPattern
-                                    cl_float4,    // scaleMul
-                                    float         // blackLevel
-                                    >(program, "scaleRawData");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                cl::Image2D,  // scaledRawImage
+                                                int,          // bayerPattern
+                                                cl_float4,    // scaleMul
+                                                float         // blackLevel
+                                                >("demosaic", "scaleRawData");
 
     // Work on one Quad (2x2) at a time
-    kernel(gls::OpenCLContext::buildEnqueueArgs(scaledRawImage->width/2, scaledRawImage->height/2),
-           rawImage.getImage2D(), scaledRawImage->getImage2D(), bayerPattern, {scaleMul[0], scaleMul[1], scaleMul[2], scaleMul[3]}, blackLevel);
+    glsContext->enqueue(kernel, scaledRawImage->width/2, scaledRawImage->height/2,
+                        rawImage.getImage2D(), scaledRawImage->getImage2D(), bayerPattern, {scaleMul[0], scaleMul[1], scaleMul[2], scaleMul[3]}, blackLevel);
 }
 
 void interpolateGreen(gls::OpenCLContext* glsContext,
                      const gls::cl_image_2d<gls::luma_pixel_float>& rawImage,
                      gls::cl_image_2d<gls::luma_pixel_float>* greenImage,
                      BayerPattern bayerPattern, float lumaVariance) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    cl::Image2D,  // greenImage
-                                    int,          // bayerPattern
-                                    float         // lumaVariance
-                                    >(program, "interpolateGreen");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                cl::Image2D,  // greenImage
+                                                int,          // bayerPattern
+                                                float         // lumaVariance
+                                                >("demosaic", "interpolateGreen");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(greenImage->width, greenImage->height),
-           rawImage.getImage2D(), greenImage->getImage2D(), bayerPattern, lumaVariance);
+    glsContext->enqueue(kernel, greenImage->width, greenImage->height,
+                        rawImage.getImage2D(), greenImage->getImage2D(), bayerPattern, lumaVariance);
 }
 
 void interpolateRedBlue(gls::OpenCLContext* glsContext,
@@ -67,21 +61,18 @@ void interpolateRedBlue(gls::OpenCLContext* glsContext,
                        const gls::cl_image_2d<gls::luma_pixel_float>& greenImage,
                        gls::cl_image_2d<gls::rgba_pixel_float>* rgbImage,
                        BayerPattern bayerPattern, float chromaVariance, bool rotate_180) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    cl::Image2D,  // greenImage
-                                    cl::Image2D,  // rgbImage
-                                    int,          // bayerPattern
-                                    float,        // chromaVariance
-                                    int           // rotate_180
-                                    >(program, "interpolateRedBlue");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                cl::Image2D,  // greenImage
+                                                cl::Image2D,  // rgbImage
+                                                int,          // bayerPattern
+                                                float,        // chromaVariance
+                                                int           // rotate_180
+                                                >("demosaic", "interpolateRedBlue");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbImage->width, rgbImage->height),
-           rawImage.getImage2D(), greenImage.getImage2D(), rgbImage->getImage2D(), bayerPattern, chromaVariance, rotate_180);
+    glsContext->enqueue(kernel, rgbImage->width, rgbImage->height,
+                        rawImage.getImage2D(), greenImage.getImage2D(), rgbImage->getImage2D(), bayerPattern, chromaVariance, rotate_180);
 }
 
 void fasteDebayer(gls::OpenCLContext* glsContext,
@@ -90,18 +81,15 @@ void fasteDebayer(gls::OpenCLContext* glsContext,
                   BayerPattern bayerPattern) {
     assert(rawImage.width == 2 * rgbImage->width && rawImage.height == 2 * rgbImage->height);
 
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    cl::Image2D,  // rgbImage
-                                    int           // bayerPattern
-                                    >(program, "fastDebayer");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                cl::Image2D,  // rgbImage
+                                                int           // bayerPattern
+                                                >("demosaic", "fastDebayer");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbImage->width, rgbImage->height),
-           rawImage.getImage2D(), rgbImage->getImage2D(), bayerPattern);
+    glsContext->enqueue(kernel, rgbImage->width, rgbImage->height,
+                        rawImage.getImage2D(), rgbImage->getImage2D(), bayerPattern);
 }
 
 void rawNoiseStatistics(gls::OpenCLContext* glsContext,
@@ -112,94 +100,82 @@ void rawNoiseStatistics(gls::OpenCLContext* glsContext,
     assert(rawImage.width == 2 * meanImage->width && rawImage.height == 2 * meanImage->height);
     assert(varImage->width == meanImage->width && varImage->height == meanImage->height);
 
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    int,          // bayerPattern
-                                    cl::Image2D,  // meanImage
-                                    cl::Image2D   // varImage
-                                    >(program, "rawNoiseStatistics");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                int,          // bayerPattern
+                                                cl::Image2D,  // meanImage
+                                                cl::Image2D   // varImage
+                                                >("demosaic", "rawNoiseStatistics");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(meanImage->width, meanImage->height),
-           rawImage.getImage2D(), bayerPattern, meanImage->getImage2D(), varImage->getImage2D());
+    glsContext->enqueue(kernel, meanImage->width, meanImage->height,
+                        rawImage.getImage2D(), bayerPattern, meanImage->getImage2D(), varImage->getImage2D());
 }
 
 template <typename T1, typename T2>
-void applyKernel(gls::OpenCLContext* glsContext, const std::string& kernelName,
+void applyKernel(gls::OpenCLContext* glsContext, const char* kernelName,
                  const gls::cl_image_2d<T1>& inputImage,
                  gls::cl_image_2d<T2>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl::Image2D   // outputImage
-                                    >(program, kernelName);
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", kernelName);
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), outputImage->getImage2D());
 }
 
 template
-void applyKernel(gls::OpenCLContext* glsContext, const std::string& kernelName,
+void applyKernel(gls::OpenCLContext* glsContext, const char* kernelName,
                  const gls::cl_image_2d<gls::luma_pixel_float>& inputImage,
                  gls::cl_image_2d<gls::luma_pixel_float>* outputImage);
 
 template
-void applyKernel(gls::OpenCLContext* glsContext, const std::string& kernelName,
+void applyKernel(gls::OpenCLContext* glsContext, const char* kernelName,
                  const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                  gls::cl_image_2d<gls::rgba_pixel_float>* outputImage);
 
 template <typename T>
-void resampleImage(gls::OpenCLContext* glsContext, const std::string& kernelName, const gls::cl_image_2d<T>& inputImage,
+void resampleImage(gls::OpenCLContext* glsContext, const char* kernelName, const gls::cl_image_2d<T>& inputImage,
                    gls::cl_image_2d<T>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     const auto linear_sampler = cl::Sampler(glsContext->clContext(), true, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_LINEAR);
 
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl::Image2D,  // outputImage
-                                    cl::Sampler
-                                    >(program, kernelName);
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl::Image2D,  // outputImage
+                                                cl::Sampler
+                                                >("demosaic", kernelName);
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), outputImage->getImage2D(), linear_sampler);
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), outputImage->getImage2D(), linear_sampler);
 }
 
 template
-void resampleImage(gls::OpenCLContext* glsContext, const std::string& kernelName, const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
+void resampleImage(gls::OpenCLContext* glsContext, const char* kernelName, const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                    gls::cl_image_2d<gls::rgba_pixel_float>* outputImage);
 
 template <typename T>
 void reassembleImage(gls::OpenCLContext* glsContext, const gls::cl_image_2d<T>& inputImageDenoised0,
                      const gls::cl_image_2d<T>& inputImage1, const gls::cl_image_2d<T>& inputImageDenoised1,
                      float sharpening, gls::Vector<2> nlf, gls::cl_image_2d<T>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     const auto linear_sampler = cl::Sampler(glsContext->clContext(), true, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_LINEAR);
 
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImageDenoised0
-                                    cl::Image2D,  // inputImage1
-                                    cl::Image2D,  // inputImageDenoised1
-                                    float,        // sharpening
-                                    cl_float2,    // nlf
-                                    cl::Image2D,  // outputImage
-                                    cl::Sampler   // linear_sampler
-                                    >(program, "reassembleImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImageDenoised0
+                                                cl::Image2D,  // inputImage1
+                                                cl::Image2D,  // inputImageDenoised1
+                                                float,        // sharpening
+                                                cl_float2,    // nlf
+                                                cl::Image2D,  // outputImage
+                                                cl::Sampler   // linear_sampler
+                                                >("demosaic", "reassembleImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImageDenoised0.getImage2D(), inputImage1.getImage2D(), inputImageDenoised1.getImage2D(),
-           sharpening, { nlf[0], nlf[1] }, outputImage->getImage2D(), linear_sampler);
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImageDenoised0.getImage2D(), inputImage1.getImage2D(), inputImageDenoised1.getImage2D(),
+                        sharpening, { nlf[0], nlf[1] }, outputImage->getImage2D(), linear_sampler);
 }
 
 template
@@ -211,9 +187,6 @@ void transformImage(gls::OpenCLContext* glsContext,
                     const gls::cl_image_2d<gls::rgba_pixel_float>& linearImage,
                     gls::cl_image_2d<gls::rgba_pixel_float>* rgbImage,
                     const gls::Matrix<3, 3>& transform) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     struct Matrix3x3 {
         cl_float3 m[3];
     } clTransform = {{
@@ -223,14 +196,14 @@ void transformImage(gls::OpenCLContext* glsContext,
     }};
 
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // linearImage
-                                    cl::Image2D,  // rgbImage
-                                    Matrix3x3     // transform
-                                    >(program, "transformImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // linearImage
+                                                cl::Image2D,  // rgbImage
+                                                Matrix3x3     // transform
+                                                >("demosaic", "transformImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbImage->width, rgbImage->height),
-           linearImage.getImage2D(), rgbImage->getImage2D(), clTransform);
+    glsContext->enqueue(kernel, rgbImage->width, rgbImage->height,
+                        linearImage.getImage2D(), rgbImage->getImage2D(), clTransform);
 }
 
 void convertTosRGB(gls::OpenCLContext* glsContext,
@@ -238,9 +211,6 @@ void convertTosRGB(gls::OpenCLContext* glsContext,
                   const gls::cl_image_2d<gls::luma_pixel_float>& ltmMaskImage,
                   gls::cl_image_2d<gls::rgba_pixel>* rgbImage,
                   const DemosaicParameters& demosaicParameters) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     const auto& transform = demosaicParameters.rgb_cam;
 
     struct Matrix3x3 {
@@ -252,38 +222,35 @@ void convertTosRGB(gls::OpenCLContext* glsContext,
     }};
 
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // linearImage
-                                    cl::Image2D,  // ltmMaskImage
-                                    cl::Image2D,  // rgbImage
-                                    Matrix3x3,    // transform
-                                    RGBConversionParameters    // demosaicParameters
-                                    >(program, "convertTosRGB");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // linearImage
+                                                cl::Image2D,  // ltmMaskImage
+                                                cl::Image2D,  // rgbImage
+                                                Matrix3x3,    // transform
+                                                RGBConversionParameters    // demosaicParameters
+                                                >("demosaic", "convertTosRGB");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbImage->width, rgbImage->height),
-           linearImage.getImage2D(), ltmMaskImage.getImage2D(), rgbImage->getImage2D(), clTransform, demosaicParameters.rgbConversionParameters);
+    glsContext->enqueue(kernel, rgbImage->width, rgbImage->height,
+                        linearImage.getImage2D(), ltmMaskImage.getImage2D(), rgbImage->getImage2D(), clTransform, demosaicParameters.rgbConversionParameters);
 }
 
 void despeckleImage(gls::OpenCLContext* glsContext,
                     const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                     const gls::Vector<3>& var_a, const gls::Vector<3>& var_b,
                     gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl_float3,    // var_a
-                                    cl_float3,    // var_b
-                                    cl::Image2D   // outputImage
-                                    >(program, "despeckleLumaMedianChromaImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl_float3,    // var_a
+                                                cl_float3,    // var_b
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "despeckleLumaMedianChromaImage");
 
     cl_float3 cl_var_a = { var_a[0], var_a[1], var_a[2] };
     cl_float3 cl_var_b = { var_b[0], var_b[1], var_b[2] };
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), cl_var_a, cl_var_b, outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), cl_var_a, cl_var_b, outputImage->getImage2D());
 }
 
 // --- Multiscale Noise Reduction ---
@@ -294,46 +261,40 @@ void denoiseImage(gls::OpenCLContext* glsContext,
                   const gls::Vector<3>& var_a, const gls::Vector<3>& var_b,
                   float chromaBoost, float gradientBoost,
                   gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl_float3,    // var_a
-                                    cl_float3,    // var_b
-                                    float,        // chromaBoost
-                                    float,        // gradientBoost
-                                    cl::Image2D   // outputImage
-                                    >(program, "denoiseImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl_float3,    // var_a
+                                                cl_float3,    // var_b
+                                                float,        // chromaBoost
+                                                float,        // gradientBoost
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "denoiseImage");
 
     cl_float3 cl_var_a = { var_a[0], var_a[1], var_a[2] };
     cl_float3 cl_var_b = { var_b[0], var_b[1], var_b[2] };
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), cl_var_a, cl_var_b, chromaBoost, gradientBoost, outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), cl_var_a, cl_var_b, chromaBoost, gradientBoost, outputImage->getImage2D());
 }
 
 void denoiseImageGuided(gls::OpenCLContext* glsContext,
                         const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                         const gls::Vector<3>& var_a, const gls::Vector<3>& var_b,
                         gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl_float3,    // var_a
-                                    cl_float3,    // ver_b
-                                    cl::Image2D   // outputImage
-                                    >(program, "denoiseImageGuided");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl_float3,    // var_a
+                                                cl_float3,    // ver_b
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "denoiseImageGuided");
 
     cl_float3 cl_var_a = { var_a[0], var_a[1], var_a[2] };
     cl_float3 cl_var_b = { var_b[0], var_b[1], var_b[2] };
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), cl_var_a, cl_var_b, outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), cl_var_a, cl_var_b, outputImage->getImage2D());
 }
 
 void localToneMappingMask(gls::OpenCLContext* glsContext,
@@ -341,9 +302,6 @@ void localToneMappingMask(gls::OpenCLContext* glsContext,
                           const gls::cl_image_2d<gls::rgba_pixel_float>& guideImage,
                           const LTMParameters& ltmParameters, const gls::Matrix<3, 3>& transform,
                           gls::cl_image_2d<gls::luma_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     struct Matrix3x3 {
         cl_float3 m[3];
     } clTransform = {{
@@ -355,18 +313,18 @@ void localToneMappingMask(gls::OpenCLContext* glsContext,
     const auto linear_sampler = cl::Sampler(glsContext->clContext(), true, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_LINEAR);
 
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl::Image2D,  // guideImage
-                                    LTMParameters,// ltmParameters
-                                    Matrix3x3,    // transform
-                                    cl::Image2D,  // outputImage
-                                    cl::Sampler   // linear_sampler
-                                    >(program, "localToneMappingMaskImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl::Image2D,  // guideImage
+                                                LTMParameters,// ltmParameters
+                                                Matrix3x3,    // transform
+                                                cl::Image2D,  // outputImage
+                                                cl::Sampler   // linear_sampler
+                                                >("demosaic", "localToneMappingMaskImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), guideImage.getImage2D(), ltmParameters, clTransform,
-           outputImage->getImage2D(), linear_sampler);
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), guideImage.getImage2D(), ltmParameters, clTransform,
+                        outputImage->getImage2D(), linear_sampler);
 }
 
 void bayerToRawRGBA(gls::OpenCLContext* glsContext,
@@ -375,18 +333,15 @@ void bayerToRawRGBA(gls::OpenCLContext* glsContext,
                     BayerPattern bayerPattern) {
     assert(rawImage.width == 2 * rgbaImage->width && rawImage.height == 2 * rgbaImage->height);
 
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rawImage
-                                    cl::Image2D,  // rgbaImage
-                                    int           // bayerPattern
-                                    >(program, "bayerToRawRGBA");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rawImage
+                                                cl::Image2D,  // rgbaImage
+                                                int           // bayerPattern
+                                                >("demosaic", "bayerToRawRGBA");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbaImage->width, rgbaImage->height),
-           rawImage.getImage2D(), rgbaImage->getImage2D(), bayerPattern);
+    glsContext->enqueue(kernel, rgbaImage->width, rgbaImage->height,
+                        rawImage.getImage2D(), rgbaImage->getImage2D(), bayerPattern);
 }
 
 void rawRGBAToBayer(gls::OpenCLContext* glsContext,
@@ -395,72 +350,60 @@ void rawRGBAToBayer(gls::OpenCLContext* glsContext,
                     BayerPattern bayerPattern) {
     assert(rawImage->width == 2 * rgbaImage.width && rawImage->height == 2 * rgbaImage.height);
 
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // rgbaImage
-                                    cl::Image2D,  // rawImage
-                                    int           // bayerPattern
-                                    >(program, "rawRGBAToBayer");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // rgbaImage
+                                                cl::Image2D,  // rawImage
+                                                int           // bayerPattern
+                                                >("demosaic", "rawRGBAToBayer");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(rgbaImage.width, rgbaImage.height),
-           rgbaImage.getImage2D(), rawImage->getImage2D(), bayerPattern);
+    glsContext->enqueue(kernel, rgbaImage.width, rgbaImage.height,
+                        rgbaImage.getImage2D(), rawImage->getImage2D(), bayerPattern);
 }
 
 void denoiseRawRGBAImage(gls::OpenCLContext* glsContext,
                          const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                          const gls::Vector<4> rawVariance,
                          gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl_float4,    // rawVariance
-                                    cl::Image2D   // outputImage
-                                    >(program, "denoiseRawRGBAImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl_float4,    // rawVariance
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "denoiseRawRGBAImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), { rawVariance[0], rawVariance[1], rawVariance[2], rawVariance[3] }, outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), { rawVariance[0], rawVariance[1], rawVariance[2], rawVariance[3] }, outputImage->getImage2D());
 }
 
 void despeckleRawRGBAImage(gls::OpenCLContext* glsContext,
                            const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                            gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    cl::Image2D   // outputImage
-                                    >(program, "despeckleRawRGBAImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "despeckleRawRGBAImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), outputImage->getImage2D());
 }
 
 void gaussianBlurImage(gls::OpenCLContext* glsContext,
                        const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                        float radius,
                        gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     const bool ordinary_gaussian = false;
     if (ordinary_gaussian) {
         // Bind the kernel parameters
-        auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                        float,        // radius
-                                        cl::Image2D   // outputImage
-                                        >(program, "gaussianBlurImage");
+        auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                    float,        // radius
+                                                    cl::Image2D   // outputImage
+                                                    >("demosaic", "gaussianBlurImage");
 
         // Schedule the kernel on the GPU
-        kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-               inputImage.getImage2D(), radius, outputImage->getImage2D());
+        glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                            inputImage.getImage2D(), radius, outputImage->getImage2D());
     } else {
         const int kernelSize = (int) (2 * ceil(2.5 * radius) + 1);
 
@@ -490,16 +433,16 @@ void gaussianBlurImage(gls::OpenCLContext* glsContext,
         const auto linear_sampler = cl::Sampler(glsContext->clContext(), true, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_LINEAR);
 
         // Bind the kernel parameters
-        auto kernel = cl::KernelFunctor<cl::Image2D,    // inputImage
-                                        int,            // samples
-                                        cl::Buffer,     // weights
-                                        cl::Image2D,    // outputImage
-                                        cl::Sampler     // linear_sampler
-                                        >(program, "sampledConvolution");
+        auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // inputImage
+                                                    int,            // samples
+                                                    cl::Buffer,     // weights
+                                                    cl::Image2D,    // outputImage
+                                                    cl::Sampler     // linear_sampler
+                                                    >("demosaic", "sampledConvolution");
 
         // Schedule the kernel on the GPU
-        kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-               inputImage.getImage2D(), weightsCount, weightsBuffer, outputImage->getImage2D(), linear_sampler);
+        glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                            inputImage.getImage2D(), weightsCount, weightsBuffer, outputImage->getImage2D(), linear_sampler);
     }
 }
 
@@ -507,16 +450,13 @@ void blendHighlightsImage(gls::OpenCLContext* glsContext,
                           const gls::cl_image_2d<gls::rgba_pixel_float>& inputImage,
                           float clip,
                           gls::cl_image_2d<gls::rgba_pixel_float>* outputImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("demosaic");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,  // inputImage
-                                    float,        // clip
-                                    cl::Image2D   // outputImage
-                                    >(program, "blendHighlightsImage");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,  // inputImage
+                                                float,        // clip
+                                                cl::Image2D   // outputImage
+                                                >("demosaic", "blendHighlightsImage");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(outputImage->width, outputImage->height),
-           inputImage.getImage2D(), clip, outputImage->getImage2D());
+    glsContext->enqueue(kernel, outputImage->width, outputImage->height,
+                        inputImage.getImage2D(), clip, outputImage->getImage2D());
 }
@@ -21,7 +21,7 @@
 #include "gls_cl_image.hpp"
 
 template <typename T1, typename T2>
-void applyKernel(gls::OpenCLContext* glsContext, const std::string& kernelName,
+void applyKernel(gls::OpenCLContext* glsContext, const char* kernelName,
                  const gls::cl_image_2d<T1>& inputImage,
                  gls::cl_image_2d<T2>* outputImage);
 
@@ -53,7 +53,7 @@ void rawNoiseStatistics(gls::OpenCLContext* glsContext,
                         gls::cl_image_2d<gls::rgba_pixel_float>* varImage);
 
 template <typename T>
-void resampleImage(gls::OpenCLContext* glsContext, const std::string& kernelName,
+void resampleImage(gls::OpenCLContext* glsContext, const char* kernelName,
                    const gls::cl_image_2d<T>& inputImage, gls::cl_image_2d<T>* outputImage);
 
 template <typename T>
@@ -30,21 +30,18 @@ void BoxBlur<PixelType>::blur(gls::OpenCLContext* glsContext,
     assert(inputImage.width == outputImage->width && inputImage.height == outputImage->height &&
            inputImage.width == tmp_image->height && inputImage.height == tmp_image->width);
 
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // inputImage
-                                     int,           // filterSize
-                                     cl::Image2D    // outputImage
-                                     >(program, "boxBlurX");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // inputImage
+                                                 int,           // filterSize
+                                                 cl::Image2D    // outputImage
+                                                 >("guided_filter", "boxBlurX");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(inputImage.width, inputImage.height),
-           inputImage.getImage2D(), filterSize, tmp_image->getImage2D());
+    glsContext->enqueue(kernel, inputImage.width, inputImage.height,
+                        inputImage.getImage2D(), filterSize, tmp_image->getImage2D());
 
-    kernel(gls::OpenCLContext::buildEnqueueArgs(tmp_image->width, tmp_image->height),
-           tmp_image->getImage2D(), filterSize, outputImage->getImage2D());
+    glsContext->enqueue(kernel, tmp_image->width, tmp_image->height,
+                        tmp_image->getImage2D(), filterSize, outputImage->getImage2D());
 }
 
 template struct BoxBlur<gls::pixel_float4>;
@@ -69,18 +66,15 @@ void covMatrixProducts(gls::OpenCLContext* glsContext,
                        const gls::cl_image_2d<gls::pixel_float4>& inputImage,
                        gls::cl_image_2d<gls::pixel_fp32_4>* products1Image,
                        gls::cl_image_2d<gls::pixel_fp32_2>* products2Image) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // inputImage
-                                    cl::Image2D,    // products1Image
-                                    cl::Image2D     // products2Image
-                                     >(program, "covMatrixProducts");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // inputImage
+                                                cl::Image2D,    // products1Image
+                                                cl::Image2D     // products2Image
+                                                 >("guided_filter", "covMatrixProducts");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(inputImage.width, inputImage.height),
-           inputImage.getImage2D(), products1Image->getImage2D(), products2Image->getImage2D());
+    glsContext->enqueue(kernel, inputImage.width, inputImage.height,
+                        inputImage.getImage2D(), products1Image->getImage2D(), products2Image->getImage2D());
 }
 
 void invSigma(gls::OpenCLContext* glsContext,
@@ -88,24 +82,21 @@ void invSigma(gls::OpenCLContext* glsContext,
               gls::cl_image_2d<gls::pixel_fp32_4>* invSigma1,
               gls::cl_image_2d<gls::pixel_fp32_2>* invSigma2,
               const gls::Vector<3>& eps) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // meanImage
-                                    cl::Image2D,    // products1Image
-                                    cl::Image2D,    // products2Image
-                                    cl_float3,      // eps
-                                    cl::Image2D,    // invSigma1
-                                    cl::Image2D     // invSigma2
-                                    >(program, "invSigma");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // meanImage
+                                                cl::Image2D,    // products1Image
+                                                cl::Image2D,    // products2Image
+                                                cl_float3,      // eps
+                                                cl::Image2D,    // invSigma1
+                                                cl::Image2D     // invSigma2
+                                                >("guided_filter", "invSigma");
 
     cl_float3 cl_eps = { eps[0], eps[1], eps[2] };
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(meanImage.width, meanImage.height),
-           meanImage.getImage2D(), invSigma1->getImage2D(), invSigma2->getImage2D(), cl_eps,
-           invSigma1->getImage2D(), invSigma2->getImage2D());
+    glsContext->enqueue(kernel, meanImage.width, meanImage.height,
+                        meanImage.getImage2D(), invSigma1->getImage2D(), invSigma2->getImage2D(), cl_eps,
+                        invSigma1->getImage2D(), invSigma2->getImage2D());
 }
 
 void meanIpProducts(gls::OpenCLContext* glsContext,
@@ -113,19 +104,16 @@ void meanIpProducts(gls::OpenCLContext* glsContext,
                     gls::cl_image_2d<gls::pixel_fp32_4>* mean_Ip_r,
                     gls::cl_image_2d<gls::pixel_fp32_4>* mean_Ip_g,
                     gls::cl_image_2d<gls::pixel_fp32_4>* mean_Ip_b) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // inputImage
-                                    cl::Image2D,    // mean_Ip_r
-                                    cl::Image2D,    // mean_Ip_g
-                                    cl::Image2D     // mean_Ip_b
-                                    >(program, "meanIpProducts");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // inputImage
+                                                cl::Image2D,    // mean_Ip_r
+                                                cl::Image2D,    // mean_Ip_g
+                                                cl::Image2D     // mean_Ip_b
+                                                >("guided_filter", "meanIpProducts");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(inputImage.width, inputImage.height),
-           inputImage.getImage2D(), mean_Ip_r->getImage2D(), mean_Ip_g->getImage2D(), mean_Ip_b->getImage2D());
+    glsContext->enqueue(kernel, inputImage.width, inputImage.height,
+                        inputImage.getImage2D(), mean_Ip_r->getImage2D(), mean_Ip_g->getImage2D(), mean_Ip_b->getImage2D());
 }
 
 void computeAb(gls::OpenCLContext* glsContext,
@@ -138,32 +126,29 @@ void computeAb(gls::OpenCLContext* glsContext,
                gls::cl_image_2d<gls::pixel_fp32_4>* ab_rImage,
                gls::cl_image_2d<gls::pixel_fp32_4>* ab_gImage,
                gls::cl_image_2d<gls::pixel_fp32_4>* ab_bImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // mean_pImage
-                                    cl::Image2D,    // mean_Ip_rImage
-                                    cl::Image2D,    // mean_Ip_gImage
-                                    cl::Image2D,    // mean_Ip_bImage
-                                    cl::Image2D,    // invSigma1Image
-                                    cl::Image2D,    // invSigma2Image
-                                    cl::Image2D,    // ab_rImage
-                                    cl::Image2D,    // ab_gImage
-                                    cl::Image2D     // ab_bImage
-                                    >(program, "computeAb");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // mean_pImage
+                                                cl::Image2D,    // mean_Ip_rImage
+                                                cl::Image2D,    // mean_Ip_gImage
+                                                cl::Image2D,    // mean_Ip_bImage
+                                                cl::Image2D,    // invSigma1Image
+                                                cl::Image2D,    // invSigma2Image
+                                                cl::Image2D,    // ab_rImage
+                                                cl::Image2D,    // ab_gImage
+                                                cl::Image2D     // ab_bImage
+                                                >("guided_filter", "computeAb");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(mean_pImage.width, mean_pImage.height),
-           mean_pImage.getImage2D(),
-           mean_Ip_rImage.getImage2D(),
-           mean_Ip_gImage.getImage2D(),
-           mean_Ip_bImage.getImage2D(),
-           invSigma1Image.getImage2D(),
-           invSigma2Image.getImage2D(),
-           ab_rImage->getImage2D(),
-           ab_gImage->getImage2D(),
-           ab_bImage->getImage2D());
+    glsContext->enqueue(kernel, mean_pImage.width, mean_pImage.height,
+                        mean_pImage.getImage2D(),
+                        mean_Ip_rImage.getImage2D(),
+                        mean_Ip_gImage.getImage2D(),
+                        mean_Ip_bImage.getImage2D(),
+                        invSigma1Image.getImage2D(),
+                        invSigma2Image.getImage2D(),
+                        ab_rImage->getImage2D(),
+                        ab_gImage->getImage2D(),
+                        ab_bImage->getImage2D());
 }
 
 void computeResult(gls::OpenCLContext* glsContext,
@@ -172,24 +157,21 @@ void computeResult(gls::OpenCLContext* glsContext,
                    const gls::cl_image_2d<gls::pixel_fp32_4>& ab_gImage,
                    const gls::cl_image_2d<gls::pixel_fp32_4>& ab_bImage,
                    gls::cl_image_2d<gls::pixel_float4>* resultImage) {
-    // Load the shader source
-    const auto program = glsContext->loadProgram("guided_filter");
-
     // Bind the kernel parameters
-    auto kernel = cl::KernelFunctor<cl::Image2D,    // inputImage
-                                    cl::Image2D,    // ab_rImage
-                                    cl::Image2D,    // ab_gImage
-                                    cl::Image2D,    // ab_bImage
-                                    cl::Image2D     // resultImage
-                                    >(program, "computeResult");
+    auto kernel = glsContext->loadKernelFunctor<cl::Image2D,    // inputImage
+                                                cl::Image2D,    // ab_rImage
+                                                cl::Image2D,    // ab_gImage
+                                                cl::Image2D,    // ab_bImage
+                                                cl::Image2D     // resultImage
+                                                >("guided_filter", "computeResult");
 
     // Schedule the kernel on the GPU
-    kernel(gls::OpenCLContext::buildEnqueueArgs(inputImage.width, inputImage.height),
-           inputImage.getImage2D(),
-           ab_rImage.getImage2D(),
-           ab_gImage.getImage2D(),
-           ab_bImage.getImage2D(),
-           resultImage->getImage2D());
+    glsContext->enqueue(kernel, inputImage.width, inputImage.height,
+                        inputImage.getImage2D(),
+                        ab_rImage.getImage2D(),
+                        ab_gImage.getImage2D(),
+                        ab_bImage.getImage2D(),
+                        resultImage->getImage2D());
 }
 
 void GuidedFilter::filter(gls::OpenCLContext* glsContext,
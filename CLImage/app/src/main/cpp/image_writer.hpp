@@ -0,0 +1,154 @@
+// Copyright (c) 2021-2022 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef image_writer_hpp
+#define image_writer_hpp
+
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gls_cl_image.hpp"
+#include "gls_image.hpp"
+
+#include "ThreadPool.hpp"
+
+// Encodes and writes pipeline outputs on a pool of worker threads, so that the GPU can move on to the next frame
+// while the previous one is being compressed. At most maxPending images are queued: submitting more blocks the
+// caller until a write completes. Each write returns a future that reports its completion or rethrows its error.
+// With an OpenCLContext, OpenCL images are read back without blocking the caller.
+class ImageWriter {
+    gls::OpenCLContext* const _glsContext;
+    const int _maxPending;
+    int _pending = 0;
+    std::mutex _mutex;
+    std::condition_variable _writeCompleted;
+    ThreadPool _threadPool;
+
+    void acquireSlot() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _writeCompleted.wait(lock, [this] { return _pending < _maxPending; });
+        _pending++;
+    }
+
+    void releaseSlot() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _pending--;
+        }
+        _writeCompleted.notify_all();
+    }
+
+    // The image is written once ready has completed, the caller holds a slot released when the write is done
+    template <typename T, typename F>
+    std::future<void> submit(std::shared_ptr<const gls::image<T>> image, F write, cl::Event ready = cl::Event()) {
+        return _threadPool.enqueue([this, image, write, ready]() {
+            struct slot_release {
+                ImageWriter* writer;
+                ~slot_release() { writer->releaseSlot(); }
+            } release = { this };
+            if (ready()) {
+                ready.wait();
+            }
+            write(*image);
+        });
+    }
+
+    template <typename T, typename F>
+    std::future<void> enqueue(std::shared_ptr<const gls::image<T>> image, F write) {
+        acquireSlot();
+        try {
+            return submit<T>(image, write);
+        } catch (...) {
+            releaseSlot();
+            throw;
+        }
+    }
+
+    // The slot is taken before the copy, so that at most maxPending host images and readbacks are in flight
+    template <typename F>
+    std::future<void> enqueueCopy(const gls::cl_image_2d<gls::rgba_pixel>& clImage, F write) {
+        acquireSlot();
+        try {
+            const auto [image, copied] = copyImage(clImage);
+            return submit<gls::rgba_pixel>(image, write, copied);
+        } catch (...) {
+            releaseSlot();
+            throw;
+        }
+    }
+
+    // Copy the GPU output to host memory, so that its OpenCL image can be reused for the next frame. With an
+    // OpenCLContext the copy is asynchronous, and complete with the returned event.
+    std::pair<std::shared_ptr<const gls::image<gls::rgba_pixel>>, cl::Event> copyImage(
+        const gls::cl_image_2d<gls::rgba_pixel>& clImage) {
+        auto image = std::make_shared<gls::image<gls::rgba_pixel>>(clImage.width, clImage.height);
+        if (_glsContext) {
+            const auto copied = _glsContext->enqueueTransfer(clImage.getImage2D(), /*write=*/ false,
+                                                             [&](const std::vector<cl::Event>& dependencies) {
+                                                                 return clImage.copyPixelsToAsync(image.get(), dependencies);
+                                                             });
+            return { image, copied };
+        }
+        const auto mappedImage = clImage.mapImage();
+        for (int y = 0; y < clImage.height; y++) {
+            std::copy(mappedImage[y], mappedImage[y] + clImage.width, (*image)[y]);
+        }
+        clImage.unmapImage(mappedImage);
+        return { image, cl::Event() };
+    }
+
+   public:
+    ImageWriter(int threads = 2, int maxPending = 4) : ImageWriter(nullptr, threads, maxPending) {}
+
+    ImageWriter(gls::OpenCLContext* glsContext, int threads = 2, int maxPending = 4)
+        : _glsContext(glsContext), _maxPending(std::max(maxPending, 1)), _threadPool(std::max(threads, 1)) {}
+
+    template <typename T>
+    std::future<void> writeJpegFile(std::unique_ptr<gls::image<T>> image, const std::string& filename, int quality) {
+        return enqueue<T>(std::move(image), [filename, quality](const gls::image<T>& image) {
+            image.write_jpeg_file(filename, quality);
+        });
+    }
+
+    template <typename T>
+    std::future<void> writePngFile(std::unique_ptr<gls::image<T>> image, const std::string& filename,
+                                   int compression_level = 0) {
+        return enqueue<T>(std::move(image), [filename, compression_level](const gls::image<T>& image) {
+            image.write_png_file(filename, /*skip_alpha=*/ true, compression_level);
+        });
+    }
+
+    std::future<void> writeJpegFile(const gls::cl_image_2d<gls::rgba_pixel>& clImage, const std::string& filename,
+                                    int quality) {
+        return enqueueCopy(clImage, [filename, quality](const gls::image<gls::rgba_pixel>& image) {
+            image.write_jpeg_file(filename, quality);
+        });
+    }
+
+    std::future<void> writePngFile(const gls::cl_image_2d<gls::rgba_pixel>& clImage, const std::string& filename,
+                                   int compression_level = 0) {
+        return enqueueCopy(clImage, [filename, compression_level](const gls::image<gls::rgba_pixel>& image) {
+            image.write_png_file(filename, /*skip_alpha=*/ true, compression_level);
+        });
+    }
+};
+
+#endif /* image_writer_hpp */
@@ -159,9 +159,9 @@ bool inRange(const gls::DVector<N>& v, double minValue, double maxValue) {
 }
 
 gls::Vector<6> computeNoiseStatistics(gls::OpenCLContext* glsContext, const gls::cl_image_2d<gls::rgba_pixel_float>& image) {
-    gls::cl_image_2d<gls::rgba_pixel_float> noiseStats(glsContext->clContext(), image.width, image.height);
-    applyKernel(glsContext, "noiseStatistics", image, &noiseStats);
-    const auto noiseStatsCpu = noiseStats.mapImage();
+    auto noiseStats = glsContext->imagePool().acquire<gls::rgba_pixel_float>(image.width, image.height);
+    applyKernel(glsContext, "noiseStatistics", image, noiseStats.get());
+    const auto noiseStatsCpu = noiseStats->mapImage();
 
     // Only consider pixels with variance lower than the expected noise value
     const double varianceMax = 0.001;
@@ -247,7 +247,7 @@ gls::Vector<6> computeNoiseStatistics(gls::OpenCLContext* glsContext, const gls:
     std::cout << "Pyramid NLF A: " << std::setprecision(4) << std::scientific << nlfA << ", B: " << nlfB << ", err2: " << newErr2
               << " on " << std::setprecision(1) << std::fixed << 100 * N / (image.width * image.height) << "% pixels"<< std::endl;
 
-    noiseStats.unmapImage(noiseStatsCpu);
+    noiseStats->unmapImage(noiseStatsCpu);
 
     return {
         (float) nlfA[0], (float) nlfA[1], (float) nlfA[2], // A values
@@ -257,13 +257,31 @@ gls::Vector<6> computeNoiseStatistics(gls::OpenCLContext* glsContext, const gls:
 
 
 gls::Vector<8> computeRawNoiseStatistics(gls::OpenCLContext* glsContext, const gls::cl_image_2d<gls::luma_pixel_float>& rawImage, BayerPattern bayerPattern) {
-    gls::cl_image_2d<gls::rgba_pixel_float> meanImage(glsContext->clContext(), rawImage.width / 2, rawImage.height / 2);
-    gls::cl_image_2d<gls::rgba_pixel_float> varImage(glsContext->clContext(), rawImage.width / 2, rawImage.height / 2);
-
-    rawNoiseStatistics(glsContext, rawImage, bayerPattern, &meanImage, &varImage);
-
-    const auto meanImageCpu = meanImage.mapImage();
-    const auto varImageCpu = varImage.mapImage();
+    auto& imagePool = glsContext->imagePool();
+    auto meanImage = imagePool.acquire<gls::rgba_pixel_float>(rawImage.width / 2, rawImage.height / 2);
+    auto varImage = imagePool.acquire<gls::rgba_pixel_float>(rawImage.width / 2, rawImage.height / 2);
+
+    rawNoiseStatistics(glsContext, rawImage, bayerPattern, meanImage.get(), varImage.get());
+
+    // Read only mappings, the statistics are not copied back to the device on unmap. The maps are ordered after the
+    // rawNoiseStatistics kernel writing the images by the context's dependency tracking.
+    const auto mapForReading = [glsContext](const gls::cl_image_2d<gls::rgba_pixel_float>& image, cl::Event* mapEvent) {
+        std::unique_ptr<gls::image<gls::rgba_pixel_float>> mappedImage;
+        *mapEvent = glsContext->enqueueTransfer(image.getImage2D(), /*write=*/ false,
+                                                [&](const std::vector<cl::Event>& dependencies) {
+                                                    cl::Event event;
+                                                    mappedImage.reset(new gls::image<gls::rgba_pixel_float>(
+                                                        image.mapImageAsync(&event, dependencies, CL_MAP_READ)));
+                                                    return event;
+                                                });
+        return mappedImage;
+    };
+    std::vector<cl::Event> mapEvents(2);
+    const auto meanImageMapping = mapForReading(*meanImage, &mapEvents[0]);
+    const auto varImageMapping = mapForReading(*varImage, &mapEvents[1]);
+    const auto& meanImageCpu = *meanImageMapping;
+    const auto& varImageCpu = *varImageMapping;
+    cl::WaitForEvents(mapEvents);
 
     // Only consider pixels with variance lower than the expected noise value
     const double varianceMax = 0.001;
@@ -352,8 +370,8 @@ gls::Vector<8> computeRawNoiseStatistics(gls::OpenCLContext* glsContext, const g
     std::cout << "RAW NLF A: " << std::setprecision(4) << std::scientific << nlfA << ", B: " << nlfB << ", err2: " << newErr2
               << " on " << std::setprecision(1) << std::fixed << 100 * N / (rawImage.width * rawImage.height) << "% pixels"<< std::endl;
 
-    meanImage.unmapImage(meanImageCpu);
-    varImage.unmapImage(varImageCpu);
+    meanImage->unmapImage(meanImageCpu);
+    varImage->unmapImage(varImageCpu);
 
     return {
         (float) nlfA[0], (float) nlfA[1], (float) nlfA[2], (float) nlfA[3], // A values
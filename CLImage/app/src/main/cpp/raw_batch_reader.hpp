@@ -0,0 +1,114 @@
+// Copyright (c) 2021-2022 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef raw_batch_reader_hpp
+#define raw_batch_reader_hpp
+
+#include <algorithm>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include "gls_image.hpp"
+#include "gls_tiff_metadata.hpp"
+
+#include "ThreadPool.hpp"
+
+// A decoded raw file with its metadata
+struct RawImage {
+    std::filesystem::path path;
+    gls::image<gls::luma_pixel_16>::unique_ptr image;
+    gls::tiff_metadata dng_metadata;
+    gls::tiff_metadata exif_metadata;
+
+    typedef std::unique_ptr<RawImage> unique_ptr;
+
+    // Reads a DNG file, or a glsraw raw cache file. The optional dng_defaults are inserted in the metadata before the file
+    // is read, so that they take precedence over the file's own tags and are used to decode the raw data.
+    static unique_ptr read(const std::filesystem::path& path, const gls::tiff_metadata* dng_defaults = nullptr) {
+        auto rawImage = std::make_unique<RawImage>();
+        rawImage->path = path;
+        if (dng_defaults) {
+            rawImage->dng_metadata = *dng_defaults;
+        }
+        if (path.extension() == ".glsraw") {
+            rawImage->image = gls::image<gls::luma_pixel_16>::read_glsraw_file(
+                path.string(), &rawImage->dng_metadata, &rawImage->exif_metadata);
+        } else {
+            rawImage->image = gls::image<gls::luma_pixel_16>::read_dng_file(path.string(), &rawImage->dng_metadata,
+                                                                             &rawImage->exif_metadata);
+        }
+        return rawImage;
+    }
+};
+
+// Decodes a list of raw files on background threads ahead of their consumer, so that file I/O and decoding
+// overlap with the GPU processing of the previous files. At most depth files are decoded ahead, bounding the
+// memory footprint; files are handed out in list order as they become ready.
+class RawBatchReader {
+    const std::vector<std::filesystem::path> _paths;
+    const int _depth;
+    const gls::tiff_metadata _dngDefaults;
+    size_t _nextPath = 0;
+    std::deque<std::future<RawImage::unique_ptr>> _pending;
+    ThreadPool _threadPool;
+
+    void prefetch() {
+        while (_pending.size() < (size_t) _depth && _nextPath < _paths.size()) {
+            _pending.push_back(_threadPool.enqueue(RawImage::read, _paths[_nextPath++], &_dngDefaults));
+        }
+    }
+
+   public:
+    // dngDefaults: camera specific tags overriding the ones in the files, see RawImage::read
+    RawBatchReader(std::vector<std::filesystem::path> paths, int depth = 2,
+                   gls::tiff_metadata dngDefaults = gls::tiff_metadata())
+        : _paths(std::move(paths)), _depth(std::max(depth, 1)), _dngDefaults(std::move(dngDefaults)),
+          _threadPool(_depth) {
+        prefetch();
+    }
+
+    // Returns the next decoded file, or nullptr at the end of the list. Decoding errors are rethrown here.
+    RawImage::unique_ptr next() {
+        if (_pending.empty()) {
+            return nullptr;
+        }
+        auto result = std::move(_pending.front());
+        _pending.pop_front();
+        prefetch();
+        return result.get();
+    }
+
+    // Raw files with a DNG extension in the given directory, sorted by name
+    static std::vector<std::filesystem::path> listDNGFiles(const std::filesystem::path& input_dir) {
+        std::vector<std::filesystem::path> directory_listing;
+        std::copy(std::filesystem::directory_iterator(input_dir), std::filesystem::directory_iterator(),
+                  std::back_inserter(directory_listing));
+        std::sort(directory_listing.begin(), directory_listing.end());
+
+        std::vector<std::filesystem::path> dng_files;
+        for (const auto& input_path : directory_listing) {
+            const auto extension = input_path.extension();
+            if ((extension == ".dng" || extension == ".DNG") && !input_path.filename().string().starts_with(".")) {
+                dng_files.push_back(input_path);
+            }
+        }
+        return dng_files;
+    }
+};
+
+#endif /* raw_batch_reader_hpp */
@@ -24,13 +24,15 @@ static const char* TAG = "RAW Converter";
 void RawConverter::allocateTextures(gls::OpenCLContext* glsContext, int width, int height) {
     auto clContext = glsContext->clContext();
 
-    if (!clRawImage) {
-        clRawImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_16>>(clContext, width, height);
+    if (!clLinearRGBImageA) {
+        for (int slot = 0; slot < slots; slot++) {
+            clRawImage[slot] = std::make_unique<gls::cl_image_2d<gls::luma_pixel_16>>(clContext, width, height);
+            clsRGBImage[slot] = std::make_unique<gls::cl_image_2d<gls::rgba_pixel>>(clContext, width, height);
+        }
         clScaledRawImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_float>>(clContext, width, height);
         clGreenImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_float>>(clContext, width, height);
         clLinearRGBImageA = std::make_unique<gls::cl_image_2d<gls::rgba_pixel_float>>(clContext, width, height);
         clLinearRGBImageB = std::make_unique<gls::cl_image_2d<gls::rgba_pixel_float>>(clContext, width, height);
-        clsRGBImage = std::make_unique<gls::cl_image_2d<gls::rgba_pixel>>(clContext, width, height);
 
         // Placeholder, only allocated if LTM is used
         ltmMaskImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_float>>(clContext, 1, 1);
@@ -60,16 +62,61 @@ void RawConverter::allocateFastDemosaicTextures(gls::OpenCLContext* glsContext,
     auto clContext = glsContext->clContext();
 
     if (!clFastLinearRGBImage) {
-        clRawImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_16>>(clContext, width, height);
+        for (int slot = 0; slot < slots; slot++) {
+            clRawImage[slot] = std::make_unique<gls::cl_image_2d<gls::luma_pixel_16>>(clContext, width, height);
+            clsFastRGBImage[slot] = std::make_unique<gls::cl_image_2d<gls::rgba_pixel>>(clContext, width/2, height/2);
+        }
         clScaledRawImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_float>>(clContext, width, height);
         clFastLinearRGBImage = std::make_unique<gls::cl_image_2d<gls::rgba_pixel_float>>(clContext, width/2, height/2);
-        clsFastRGBImage = std::make_unique<gls::cl_image_2d<gls::rgba_pixel>>(clContext, width/2, height/2);
 
         // Placeholder, not used in Fast Demosaic
         ltmMaskImage = std::make_unique<gls::cl_image_2d<gls::luma_pixel_float>>(clContext, 1, 1);
     }
 }
 
+// Waits for a non blocking upload when leaving the scope, also when unwinding from an exception, so that the caller's
+// raw data outlives the transfer reading it
+class UploadGuard {
+    const cl::Event _upload;
+
+   public:
+    UploadGuard(cl::Event upload) : _upload(std::move(upload)) { }
+
+    ~UploadGuard() {
+        // The C API doesn't throw from the destructor
+        clWaitForEvents(1, &_upload());
+    }
+};
+
+// Maps an OpenCL image for the lifetime of the scope, unmapping it also when unwinding from an exception
+template <typename T>
+class MappedImage {
+    const gls::cl_image_2d<T>& _clImage;
+
+   public:
+    const gls::image<T> image;
+
+    MappedImage(const gls::cl_image_2d<T>& clImage) : _clImage(clImage), image(clImage.mapImage()) { }
+
+    ~MappedImage() {
+        try {
+            _clImage.unmapImage(image);
+        } catch (const cl::Error& e) {
+            LOG_ERROR(TAG) << "Couldn't unmap image: " << e.what() << " (" << e.err() << ")" << std::endl;
+        }
+    }
+};
+
+// Copy input data to the OpenCL input slot without blocking: the upload only waits for the kernels still reading the
+// slot, and overlaps with the processing of the previous frame
+cl::Event RawConverter::uploadRawImage(const gls::image<gls::luma_pixel_16>& rawImage, int slot) {
+    const auto& clInputImage = *clRawImage[slot];
+    return _glsContext->enqueueTransfer(clInputImage.getImage2D(), /*write=*/ true,
+                                        [&](const std::vector<cl::Event>& dependencies) {
+                                            return clInputImage.copyPixelsFromAsync(rawImage, dependencies);
+                                        });
+}
+
 gls::cl_image_2d<gls::rgba_pixel>* RawConverter::demosaicImage(const gls::image<gls::luma_pixel_16>& rawImage,
                                                                DemosaicParameters* demosaicParameters,
                                                                const gls::rectangle* gmb_position, bool rotate_180) {
@@ -94,15 +141,16 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::demosaicImage(const gls::image<
         allocateHighNoiseTextures(_glsContext, rawImage.width, rawImage.height);
     }
 
+    const int slot = _frame++ % slots;
+
 #ifdef PRINT_EXECUTION_TIME
     auto t_start = std::chrono::high_resolution_clock::now();
 #endif
-    // Copy input data to the OpenCL input buffer
-    clRawImage->copyPixelsFrom(rawImage);
+    const UploadGuard upload(uploadRawImage(rawImage, slot));
 
     // --- Image Demosaicing ---
 
-    scaleRawData(_glsContext, *clRawImage, clScaledRawImage.get(), demosaicParameters->bayerPattern, demosaicParameters->scale_mul,
+    scaleRawData(_glsContext, *clRawImage[slot], clScaledRawImage.get(), demosaicParameters->bayerPattern, demosaicParameters->scale_mul,
                  demosaicParameters->black_level / 0xffff);
 
     const auto rawNLF = computeRawNoiseStatistics(_glsContext, *clScaledRawImage, demosaicParameters->bayerPattern);
@@ -171,7 +219,7 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::demosaicImage(const gls::image<
 
     // --- Image Post Processing ---
 
-    convertTosRGB(_glsContext, *clDenoisedImage, *ltmMaskImage, clsRGBImage.get(), *demosaicParameters);
+    convertTosRGB(_glsContext, *clDenoisedImage, *ltmMaskImage, clsRGBImage[slot].get(), *demosaicParameters);
 
 #ifdef PRINT_EXECUTION_TIME
     cl::CommandQueue queue = cl::CommandQueue::getDefault();
@@ -182,7 +230,7 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::demosaicImage(const gls::image<
     LOG_INFO(TAG) << "OpenCL Pipeline Execution Time: " << (int) elapsed_time_ms << "ms for image of size: " << rawImage.width << " x " << rawImage.height << std::endl;
 #endif
 
-    return clsRGBImage.get();
+    return clsRGBImage[slot].get();
 }
 
 gls::cl_image_2d<gls::rgba_pixel>* RawConverter::fastDemosaicImage(const gls::image<gls::luma_pixel_16>& rawImage,
@@ -191,15 +239,16 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::fastDemosaicImage(const gls::im
 
     LOG_INFO(TAG) << "Begin Fast Demosaicing (GPU)..." << std::endl;
 
+    const int slot = _frame++ % slots;
+
 #ifdef PRINT_EXECUTION_TIME
     auto t_start = std::chrono::high_resolution_clock::now();
 #endif
-    // Copy input data to the OpenCL input buffer
-    clRawImage->copyPixelsFrom(rawImage);
+    const UploadGuard upload(uploadRawImage(rawImage, slot));
 
     // --- Image Demosaicing ---
 
-    scaleRawData(_glsContext, *clRawImage, clScaledRawImage.get(), demosaicParameters.bayerPattern, demosaicParameters.scale_mul,
+    scaleRawData(_glsContext, *clRawImage[slot], clScaledRawImage.get(), demosaicParameters.bayerPattern, demosaicParameters.scale_mul,
                  demosaicParameters.black_level / 0xffff);
 
     fasteDebayer(_glsContext, *clScaledRawImage, clFastLinearRGBImage.get(), demosaicParameters.bayerPattern);
@@ -209,7 +258,7 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::fastDemosaicImage(const gls::im
 
     // --- Image Post Processing ---
 
-    convertTosRGB(_glsContext, *clFastLinearRGBImage, *ltmMaskImage, clsFastRGBImage.get(), demosaicParameters);
+    convertTosRGB(_glsContext, *clFastLinearRGBImage, *ltmMaskImage, clsFastRGBImage[slot].get(), demosaicParameters);
 
 #ifdef PRINT_EXECUTION_TIME
     cl::CommandQueue queue = cl::CommandQueue::getDefault();
@@ -220,18 +269,29 @@ gls::cl_image_2d<gls::rgba_pixel>* RawConverter::fastDemosaicImage(const gls::im
     LOG_INFO(TAG) << "OpenCL Pipeline Execution Time: " << (int) elapsed_time_ms << "ms for image of size: " << rawImage.width << " x " << rawImage.height << std::endl;
 #endif
 
-    return clsFastRGBImage.get();
+    return clsFastRGBImage[slot].get();
 }
 
 /*static*/ gls::image<gls::rgb_pixel>::unique_ptr RawConverter::convertToRGBImage(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage) {
     auto rgbImage = std::make_unique<gls::image<gls::rgb_pixel>>(clRGBAImage.width, clRGBAImage.height);
-    auto rgbaImage = clRGBAImage.mapImage();
+    const MappedImage rgbaImage(clRGBAImage);
     for (int y = 0; y < clRGBAImage.height; y++) {
         for (int x = 0; x < clRGBAImage.width; x++) {
-            const auto& p = rgbaImage[y][x];
+            const auto& p = rgbaImage.image[y][x];
             (*rgbImage)[y][x] = { p.red, p.green, p.blue };
         }
     }
-    clRGBAImage.unmapImage(rgbaImage);
     return rgbImage;
 }
+
+/*static*/ void RawConverter::saveJpegFile(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage,
+                                           const std::string& filename, int quality) {
+    const MappedImage rgbaImage(clRGBAImage);
+    rgbaImage.image.write_jpeg_file(filename, quality);
+}
+
+/*static*/ void RawConverter::savePngFile(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage,
+                                          const std::string& filename, int compression_level) {
+    const MappedImage rgbaImage(clRGBAImage);
+    rgbaImage.image.write_png_file(filename, /*skip_alpha=*/ true, compression_level);
+}
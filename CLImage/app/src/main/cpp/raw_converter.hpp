@@ -16,19 +16,29 @@
 #ifndef raw_converter_hpp
 #define raw_converter_hpp
 
+#include <array>
+
 #include "gls_cl_image.hpp"
 #include "pyramidal_denoise.hpp"
 
 class RawConverter {
     gls::OpenCLContext* _glsContext;
 
+    // Input and output textures are double buffered: frame N+1 uploads and frame N-1 reads back while frame N is
+    // being processed. Transfers are ordered with the kernels by the OpenCLContext's dependency tracking.
+    // NOTE: demosaicImage reads back the raw noise statistics right after scaling the raw data, which waits for all the
+    // work enqueued so far. On that path only the tail kernels of a frame overlap with the next upload, the fast path
+    // overlaps the whole frame.
+    static const constexpr int slots = 2;
+    int _frame = 0;
+
     // RawConverter base work textures
-    gls::cl_image_2d<gls::luma_pixel_16>::unique_ptr clRawImage;
+    std::array<gls::cl_image_2d<gls::luma_pixel_16>::unique_ptr, slots> clRawImage;
     gls::cl_image_2d<gls::luma_pixel_float>::unique_ptr clScaledRawImage;
     gls::cl_image_2d<gls::luma_pixel_float>::unique_ptr clGreenImage;
     gls::cl_image_2d<gls::rgba_pixel_float>::unique_ptr clLinearRGBImageA;
     gls::cl_image_2d<gls::rgba_pixel_float>::unique_ptr clLinearRGBImageB;
-    gls::cl_image_2d<gls::rgba_pixel>::unique_ptr clsRGBImage;
+    std::array<gls::cl_image_2d<gls::rgba_pixel>::unique_ptr, slots> clsRGBImage;
 
     std::unique_ptr<PyramidalDenoise<5>> pyramidalDenoise;
 
@@ -40,16 +50,19 @@ class RawConverter {
 
     // Fast (half resolution) RawConverter textures
     gls::cl_image_2d<gls::rgba_pixel_float>::unique_ptr clFastLinearRGBImage;
-    gls::cl_image_2d<gls::rgba_pixel>::unique_ptr clsFastRGBImage;
+    std::array<gls::cl_image_2d<gls::rgba_pixel>::unique_ptr, slots> clsFastRGBImage;
 
     void allocateTextures(gls::OpenCLContext* glsContext, int width, int height);
     void allocateLtmMaskImage(gls::OpenCLContext* glsContext, int width, int height);
     void allocateHighNoiseTextures(gls::OpenCLContext* glsContext, int width, int height);
     void allocateFastDemosaicTextures(gls::OpenCLContext* glsContext, int width, int height);
 
+    cl::Event uploadRawImage(const gls::image<gls::luma_pixel_16>& rawImage, int slot);
+
 public:
     RawConverter(gls::OpenCLContext* glsContext) : _glsContext(glsContext) { }
 
+    // The returned image stays valid until the next two calls
     gls::cl_image_2d<gls::rgba_pixel>* demosaicImage(const gls::image<gls::luma_pixel_16>& rawImage,
                                                      DemosaicParameters* demosaicParameters,
                                                      const gls::rectangle* gmb_position, bool rotate_180);
@@ -59,6 +72,13 @@ public:
 
     static gls::image<gls::rgb_pixel>::unique_ptr convertToRGBImage(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage);
 
+    // Encode the pipeline output directly from the mapped OpenCL image, skipping the RGB conversion copy
+    static void saveJpegFile(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage, const std::string& filename,
+                             int quality);
+
+    static void savePngFile(const gls::cl_image_2d<gls::rgba_pixel>& clRGBAImage, const std::string& filename,
+                            int compression_level = 0);
+
 };
 
 #endif /* raw_converter_hpp */
@@ -29,14 +29,13 @@
 #include "gls_linalg.hpp"
 
 #include "CameraCalibration.hpp"
+#include "raw_batch_reader.hpp"
+#include "image_writer.hpp"
 
 static const char* TAG = "RawPipeline Test";
 
 void copyMetadata(const gls::tiff_metadata& source, gls::tiff_metadata* destination, ttag_t tag) {
-    const auto entry = source.find(tag);
-    if (entry != source.end()) {
-        destination->insert({ tag, entry->second });
-    }
+    destination->copy_entry(source, tag);
 }
 
 void saveStrippedDNG(const std::string& file_name, const gls::image<gls::luma_pixel_16>& inputImage, const gls::tiff_metadata& dng_metadata, const gls::tiff_metadata& exif_metadata) {
@@ -86,7 +85,7 @@ void transcodeAdobeDNG(const std::filesystem::path& input_path) {
     saveStrippedDNG(output_file, *inputImage, dng_metadata, exif_metadata);
 }
 
-gls::image<gls::rgb_pixel>::unique_ptr demosaicPlainFile(RawConverter* rawConverter, const std::filesystem::path& input_path) {
+gls::cl_image_2d<gls::rgba_pixel>* demosaicPlainFile(RawConverter* rawConverter, const std::filesystem::path& input_path) {
     DemosaicParameters demosaicParameters = {
         .rgbConversionParameters = {
             .localToneMapping = false
@@ -142,7 +141,7 @@ gls::image<gls::rgb_pixel>::unique_ptr demosaicPlainFile(RawConverter* rawConver
         }
     }};
 
-    return RawConverter::convertToRGBImage(*rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false));
+    return rawConverter->demosaicImage(*inputImage, &demosaicParameters, nullptr /* &gmb_position */, /*rotate_180=*/ false);
 }
 
 void processKodakSet(gls::OpenCLContext* glsContext, const std::filesystem::path& input_path) {
@@ -209,7 +208,7 @@ void processKodakSet(gls::OpenCLContext* glsContext, const std::filesystem::path
         const auto demosaiced = demosaicPlainFile(&rawConverter, dng_file);
 
         auto demosaiced_png_file = (input_path.parent_path() / input_path.stem()).string() + "_demosaiced_5_corr.PNG";
-        demosaiced->write_png_file(demosaiced_png_file);
+        RawConverter::savePngFile(*demosaiced, demosaiced_png_file);
     }
 }
 
@@ -231,29 +230,26 @@ int main(int argc, const char* argv[]) {
         // calibrateRicohGRIII(&rawConverter, input_path.parent_path());
         // calibrateSonya6400(&rawConverter, input_path.parent_path());
 
-        auto input_dir = std::filesystem::path(input_path.parent_path());
-        std::vector<std::filesystem::path> directory_listing;
-        std::copy(std::filesystem::directory_iterator(input_dir), std::filesystem::directory_iterator(),
-                  std::back_inserter(directory_listing));
-        std::sort(directory_listing.begin(), directory_listing.end());
+        // Number of raw files decoded ahead of the GPU processing
+        const int prefetch_depth = argc > 2 ? std::max(atoi(argv[2]), 1) : 2;
 
-        for (const auto& input_path : directory_listing) {
-            const auto extension = input_path.extension();
-            if ((extension != ".dng" && extension != ".DNG") || input_path.filename().string().starts_with(".")) {
-                continue;
-            }
+        // The Glass cameras need their DNG defaults, e.g.: IMX571DngDefaults(). The outputs are read back, encoded and
+        // written in the background, while the GPU processes the next file.
+        forEachRawImage(RawBatchReader::listDNGFiles(input_path.parent_path()), prefetch_depth,
+                        [&](RawImage* rawImage, int index, ImageWriter* imageWriter) {
+            const auto& input_path = rawImage->path;
 
             LOG_INFO(TAG) << "Processing: " << input_path.filename() << std::endl;
 
             // transcodeAdobeDNG(input_path);
-            // const auto rgb_image = demosaicIMX571DNG(&rawConverter, input_path);
-            const auto rgb_image = demosaicSonya6400DNG(&rawConverter, input_path);
-            // const auto rgb_image = demosaicCanonEOSRPDNG(&rawConverter, input_path);
-            // const auto rgb_image = demosaiciPhone11(&rawConverter, input_path);
-            // const auto rgb_image = demosaicRicohGRIII2DNG(&rawConverter, input_path);
-            // const auto rgb_image = demosaicLeicaQ2DNG(&rawConverter, input_path);
-            rgb_image->write_jpeg_file((input_path.parent_path() / input_path.stem()).string() + "_rgb_wb_ltm_blacks_1.0_q.jpg", 95);
-        }
+            // const auto rgb_image = demosaicIMX571DNG(&rawConverter, rawImage);
+            const auto rgb_image = demosaicSonya6400DNG(&rawConverter, rawImage);
+            // const auto rgb_image = demosaicCanonEOSRPDNG(&rawConverter, rawImage);
+            // const auto rgb_image = demosaiciPhone11(&rawConverter, rawImage);
+            // const auto rgb_image = demosaicRicohGRIII2DNG(&rawConverter, rawImage);
+            // const auto rgb_image = demosaicLeicaQ2DNG(&rawConverter, rawImage);
+            return imageWriter->writeJpegFile(*rgb_image, (input_path.parent_path() / input_path.stem()).string() + "_rgb_wb_ltm_blacks_1.0_q.jpg", 95);
+        }, gls::tiff_metadata(), &glsContext);
 
 //        LOG_INFO(TAG) << "Processing: " << input_path.filename() << std::endl;
 //
@@ -16,6 +16,9 @@
 #ifndef auto_ptr_h
 #define auto_ptr_h
 
+#include <functional>
+#include <memory>
+
 namespace gls {
 
 // exception friendly pointer with destructor
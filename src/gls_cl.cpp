@@ -15,19 +15,53 @@
 
 #include "gls_cl.hpp"
 
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
 
+#include "gls_cl_image.hpp"
 #include "gls_logging.h"
 
 namespace gls {
 
 static const char* TAG = "CLImage";
 
+static std::string defaultCacheDirectory() {
+    if (const char* path = getenv("GLS_CL_CACHE_DIR")) {
+        return path;
+    }
+#ifndef __ANDROID__
+    if (const char* path = getenv("XDG_CACHE_HOME"); path && *path) {
+        return std::string(path) + "/climage/cl";
+    }
+    if (const char* path = getenv("HOME"); path && *path) {
+        return std::string(path) + "/.cache/climage/cl";
+    }
+#endif
+    return "";
+}
+
 #ifdef __APPLE__
 
-OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet) : _shadersRootPath(shadersRootPath) {
+OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet)
+    : _shadersRootPath(shadersRootPath), _cacheDirectory(defaultCacheDirectory()) {
     _clContext = cl::Context::getDefault();
 
     std::vector<cl::Device> devices = _clContext.getInfo<CL_CONTEXT_DEVICES>();
@@ -54,11 +88,15 @@ OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet) : _
         LOG_INFO(TAG) << "- CL_DEVICE_MAX_WORK_GROUP_SIZE: " << d.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() << std::endl;
         LOG_INFO(TAG) << "- CL_DEVICE_EXTENSIONS: " << d.getInfo<CL_DEVICE_EXTENSIONS>() << std::endl;
     }
+
+    createCommandQueue();
+    _image_pool = std::make_unique<cl_image_pool>(_clContext);
 }
 
 #elif __ANDROID__
 
-OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet) : _shadersRootPath(shadersRootPath) {
+OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet)
+    : _shadersRootPath(shadersRootPath), _cacheDirectory(defaultCacheDirectory()) {
     // Load libOpenCL
     CL_WRAPPER_NS::bindOpenCLLibrary();
 
@@ -99,9 +137,360 @@ OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet) : _
     // opencl.hpp relies on a default context
     cl::Context::setDefault(context);
     _clContext = cl::Context::getDefault();
+
+    createCommandQueue();
+    _image_pool = std::make_unique<cl_image_pool>(_clContext);
+}
+
+#else
+
+static std::string toLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+bool cl_device_selector::matches(const cl::Platform& platform, const cl::Device& device) const {
+    if ((device.getInfo<CL_DEVICE_TYPE>() & type) == 0 || !device.getInfo<CL_DEVICE_IMAGE_SUPPORT>()) {
+        return false;
+    }
+    if (name.empty()) {
+        return true;
+    }
+    const std::string pattern = toLower(name);
+    for (const auto& field : {device.getInfo<CL_DEVICE_NAME>(), platform.getInfo<CL_PLATFORM_NAME>(),
+                              platform.getInfo<CL_PLATFORM_VENDOR>()}) {
+        if (toLower(field).find(pattern) != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Static
+cl_device_selector cl_device_selector::parse(const std::string& specification) {
+    static const std::map<std::string, cl_device_type> device_types = {
+        {"gpu", CL_DEVICE_TYPE_GPU},
+        {"cpu", CL_DEVICE_TYPE_CPU},
+        {"accelerator", CL_DEVICE_TYPE_ACCELERATOR},
+        {"all", CL_DEVICE_TYPE_ALL},
+    };
+
+    cl_device_selector selector;
+    const auto separator = specification.find(':');
+    const std::string type_name = toLower(specification.substr(0, separator));
+    const auto device_type = device_types.find(type_name);
+    if (device_type != device_types.end()) {
+        selector.type = device_type->second;
+        if (separator != std::string::npos) {
+            selector.name = specification.substr(separator + 1);
+        }
+    } else if (separator == 0) {
+        selector.name = specification.substr(1);
+    } else if (separator == std::string::npos) {
+        selector.name = specification;
+    } else {
+        throw std::runtime_error("Unknown OpenCL device type: " + type_name);
+    }
+    return selector;
+}
+
+// Static
+cl_device_selector cl_device_selector::fromEnvironment() {
+    const char* specification = getenv("GLS_CL_DEVICE");
+    return specification != nullptr ? parse(specification) : cl_device_selector();
+}
+
+static int deviceTypeRank(cl_device_type type) {
+    if (type & CL_DEVICE_TYPE_GPU) {
+        return 3;
+    } else if (type & CL_DEVICE_TYPE_ACCELERATOR) {
+        return 2;
+    } else if (type & CL_DEVICE_TYPE_CPU) {
+        return 1;
+    }
+    return 0;
+}
+
+OpenCLContext::OpenCLContext(const std::string& shadersRootPath, bool quiet)
+    : OpenCLContext(shadersRootPath, cl_device_selector::fromEnvironment(), quiet) {}
+
+OpenCLContext::OpenCLContext(const std::string& shadersRootPath, const cl_device_selector& selector, bool quiet)
+    : _shadersRootPath(shadersRootPath), _cacheDirectory(defaultCacheDirectory()) {
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get(&platforms);
+
+    cl::Platform platform;
+    cl::Device device;
+    std::pair<int, cl_uint> best_rank = {-1, 0};
+    for (const auto& p : platforms) {
+        std::vector<cl::Device> devices;
+        try {
+            p.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+        } catch (const cl::Error& e) {
+            // Platforms without devices report CL_DEVICE_NOT_FOUND
+            continue;
+        }
+        for (const auto& d : devices) {
+            if (!selector.matches(p, d)) {
+                continue;
+            }
+            const std::pair<int, cl_uint> rank = {deviceTypeRank(d.getInfo<CL_DEVICE_TYPE>()),
+                                                  d.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()};
+            if (rank > best_rank) {
+                best_rank = rank;
+                platform = p;
+                device = d;
+            }
+        }
+    }
+    if (device() == nullptr) {
+        LOG_ERROR(TAG) << "No OpenCL device with image support matching type " << selector.type << " and name '"
+                       << selector.name << "' among " << platforms.size() << " platforms" << std::endl;
+        throw cl::Error(CL_DEVICE_NOT_FOUND, "No matching OpenCL device found.");
+    }
+
+    cl::Platform::setDefault(platform);
+    cl::Device::setDefault(device);
+
+    // opencl.hpp relies on a default context
+    cl::Context::setDefault(cl::Context(device));
+    _clContext = cl::Context::getDefault();
+
+    if (!quiet) {
+        cl::Device d = cl::Device::getDefault();
+        LOG_INFO(TAG) << "OpenCL Platform: " << platform.getInfo<CL_PLATFORM_NAME>() << ", "
+                      << platform.getInfo<CL_PLATFORM_VERSION>() << std::endl;
+        LOG_INFO(TAG) << "OpenCL Default Device: " << d.getInfo<CL_DEVICE_NAME>() << std::endl;
+        LOG_INFO(TAG) << "- Device Version: " << d.getInfo<CL_DEVICE_VERSION>() << std::endl;
+        LOG_INFO(TAG) << "- Driver Version: " << d.getInfo<CL_DRIVER_VERSION>() << std::endl;
+        LOG_INFO(TAG) << "- OpenCL C Version: " << d.getInfo<CL_DEVICE_OPENCL_C_VERSION>() << std::endl;
+        LOG_INFO(TAG) << "- Compute Units: " << d.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() << std::endl;
+        LOG_INFO(TAG) << "- CL_DEVICE_MAX_WORK_GROUP_SIZE: " << d.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>() << std::endl;
+        LOG_INFO(TAG) << "- CL_DEVICE_EXTENSIONS: " << d.getInfo<CL_DEVICE_EXTENSIONS>() << std::endl;
+    }
+
+    createCommandQueue();
+    _image_pool = std::make_unique<cl_image_pool>(_clContext);
 }
 #endif
 
+// Install the default command queue, out of order if the device supports it
+void OpenCLContext::createCommandQueue() {
+    cl::Device device = cl::Device::getDefault();
+    cl_command_queue_properties properties = 0;
+    if ((device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) &&
+        getenv("GLS_CL_IN_ORDER_QUEUE") == nullptr) {
+        properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    }
+    if (getenv("GLS_CL_PROFILE") != nullptr) {
+        properties |= CL_QUEUE_PROFILING_ENABLE;
+    }
+    // The default queue can only be set once, a previous context may have already set it
+    cl::CommandQueue queue = cl::CommandQueue::setDefault(cl::CommandQueue(_clContext, device, properties));
+    const auto queue_properties = queue.getInfo<CL_QUEUE_PROPERTIES>();
+    _out_of_order_queue = (queue_properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+    cl_profiler::setEnabled((queue_properties & CL_QUEUE_PROFILING_ENABLE) != 0);
+}
+
+// Kernels of the calling thread, keyed by context, program and kernel name, see loadKernel
+typedef std::map<std::tuple<uint64_t, std::string, std::string>, cl::Kernel, std::less<>> thread_kernel_cache;
+static thread_local thread_kernel_cache threadKernelCache;
+
+OpenCLContext::~OpenCLContext() {
+    const char* trace_path = getenv("GLS_CL_PROFILE");
+    if (cl_profiler::enabled() && trace_path != nullptr && *trace_path) {
+        try {
+            cl_profiler::writeTrace(trace_path);
+            std::stringstream summary;
+            cl_profiler::printSummary(summary);
+            LOG_INFO(TAG) << "OpenCL profile, trace written to " << trace_path << std::endl << summary.str();
+            const auto pool = _image_pool->getStatistics();
+            LOG_INFO(TAG) << "Image pool: " << pool.allocations << " allocations, " << pool.reuses
+                          << " reuses, high watermark " << pool.high_watermark_bytes / (1024 * 1024) << "MB"
+                          << std::endl;
+        } catch (const std::exception& e) {
+            LOG_ERROR(TAG) << "Couldn't write the OpenCL profile: " << e.what() << std::endl;
+        }
+    }
+
+    // The other threads release their kernels of this context when they exit
+    std::erase_if(threadKernelCache, [this](const auto& entry) { return std::get<0>(entry.first) == _kernel_cache_id; });
+}
+
+struct profile_entry {
+    std::string name;
+    const char* category;
+    size_t width, height;
+    cl::Event event;
+};
+
+struct profile_timing {
+    std::string name;
+    const char* category;
+    size_t width, height;
+    cl_ulong queued, submit, start, end;
+};
+
+// Pending commands are resolved into timings once their count doubles, the oldest timings are dropped past the limit
+static const size_t profile_min_pending = 256;
+static const size_t profile_max_timings = 1 << 18;
+
+static std::mutex profile_mutex;
+static bool profile_enabled = false;
+static std::vector<profile_entry> profile_entries;
+static size_t profile_resolve_size = profile_min_pending;
+static std::deque<profile_timing> profile_timings;
+
+// Moves the completed commands from profile_entries to profile_timings, releasing their events, the caller holds
+// profile_mutex
+static void resolveCompletedEntries() {
+    std::erase_if(profile_entries, [](const profile_entry& entry) {
+        try {
+            if (entry.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() > CL_COMPLETE) {
+                return false;
+            }
+            profile_timings.push_back({entry.name, entry.category, entry.width, entry.height,
+                                       entry.event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>(),
+                                       entry.event.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>(),
+                                       entry.event.getProfilingInfo<CL_PROFILING_COMMAND_START>(),
+                                       entry.event.getProfilingInfo<CL_PROFILING_COMMAND_END>()});
+        } catch (const cl::Error&) {
+            // Failed commands have no timestamps
+        }
+        return true;
+    });
+    profile_resolve_size = std::max(2 * profile_entries.size(), profile_min_pending);
+
+    if (profile_timings.size() > profile_max_timings) {
+        profile_timings.erase(profile_timings.begin(),
+                              profile_timings.begin() + (profile_timings.size() - profile_max_timings));
+    }
+}
+
+// Static
+bool cl_profiler::enabled() { return profile_enabled; }
+
+// Static
+void cl_profiler::setEnabled(bool enabled) { profile_enabled = enabled; }
+
+// Static
+void cl_profiler::record(const std::string& name, const char* category, size_t width, size_t height,
+                         const cl::Event& event) {
+    if (profile_enabled && event()) {
+        std::lock_guard<std::mutex> guard(profile_mutex);
+        profile_entries.push_back({name, category, width, height, event});
+        if (profile_entries.size() >= profile_resolve_size) {
+            resolveCompletedEntries();
+        }
+    }
+}
+
+// Static
+void cl_profiler::clear() {
+    std::lock_guard<std::mutex> guard(profile_mutex);
+    profile_entries.clear();
+    profile_resolve_size = profile_min_pending;
+    profile_timings.clear();
+}
+
+// Waits for all the recorded commands and returns their timings by start time, the caller holds profile_mutex
+static std::vector<profile_timing> profileTimings() {
+    cl::CommandQueue::getDefault().finish();
+    resolveCompletedEntries();
+
+    std::vector<profile_timing> timings(profile_timings.begin(), profile_timings.end());
+    std::sort(timings.begin(), timings.end(), [](const auto& a, const auto& b) { return a.start < b.start; });
+    return timings;
+}
+
+static std::string jsonString(const std::string& value) {
+    std::string result = "\"";
+    for (char c : value) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+// Static
+void cl_profiler::writeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> guard(profile_mutex);
+    const auto timings = profileTimings();
+
+    std::ofstream trace(path);
+    if (!trace.is_open()) {
+        throw std::runtime_error("Couldn't open trace file " + path);
+    }
+
+    // Commands overlapping in time on the out of order queue go on separate tracks
+    std::vector<cl_ulong> track_ends;
+    const cl_ulong origin = timings.empty() ? 0 : timings.front().start;
+    trace << std::fixed << std::setprecision(3) << "{\"traceEvents\": [" << std::endl;
+    for (size_t i = 0; i < timings.size(); i++) {
+        const auto& timing = timings[i];
+        size_t track = 0;
+        while (track < track_ends.size() && track_ends[track] > timing.start) {
+            track++;
+        }
+        if (track == track_ends.size()) {
+            track_ends.push_back(0);
+        }
+        track_ends[track] = timing.end;
+
+        trace << "  {\"name\": " << jsonString(timing.name) << ", \"cat\": " << jsonString(timing.category)
+              << ", \"ph\": \"X\", \"pid\": 0, \"tid\": " << track << ", \"ts\": " << (timing.start - origin) / 1000.0
+              << ", \"dur\": " << (timing.end - timing.start) / 1000.0
+              << ", \"args\": {\"size\": \"" << timing.width << "x" << timing.height << "\""
+              << ", \"queued_to_submit_us\": " << (timing.submit - timing.queued) / 1000.0
+              << ", \"submit_to_start_us\": " << (timing.start - timing.submit) / 1000.0 << "}}"
+              << (i + 1 < timings.size() ? "," : "") << std::endl;
+    }
+    trace << "], \"displayTimeUnit\": \"ms\"}" << std::endl;
+}
+
+// Static
+void cl_profiler::printSummary(std::ostream& out) {
+    struct statistics {
+        int count = 0;
+        double total = 0, min = 0, max = 0, wait = 0;
+    };
+
+    std::map<std::tuple<std::string, size_t, size_t>, statistics> stages;
+    double total_time = 0;
+    {
+        std::lock_guard<std::mutex> guard(profile_mutex);
+        for (const auto& timing : profileTimings()) {
+            const double time = (timing.end - timing.start) / 1e6;
+            auto& stage = stages[{timing.name, timing.width, timing.height}];
+            stage.min = stage.count == 0 ? time : std::min(stage.min, time);
+            stage.max = std::max(stage.max, time);
+            stage.total += time;
+            stage.wait += (timing.start - timing.queued) / 1e6;
+            stage.count++;
+            total_time += time;
+        }
+    }
+
+    std::vector<std::pair<std::tuple<std::string, size_t, size_t>, statistics>> sorted(stages.begin(), stages.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second.total > b.second.total; });
+
+    out << std::left << std::setw(36) << "Stage" << std::setw(14) << "Size" << std::right << std::setw(7) << "Count"
+        << std::setw(12) << "Total ms" << std::setw(8) << "%" << std::setw(10) << "Mean ms" << std::setw(10) << "Min ms"
+        << std::setw(10) << "Max ms" << std::setw(12) << "Wait ms" << std::endl;
+    out << std::fixed << std::setprecision(2);
+    for (const auto& [key, stage] : sorted) {
+        const auto& [name, width, height] = key;
+        out << std::left << std::setw(36) << name << std::setw(14)
+            << (std::to_string(width) + "x" + std::to_string(height)) << std::right << std::setw(7) << stage.count
+            << std::setw(12) << stage.total << std::setw(8) << 100 * stage.total / total_time << std::setw(10)
+            << stage.total / stage.count << std::setw(10) << stage.min << std::setw(10) << stage.max << std::setw(12)
+            << stage.wait / stage.count << std::endl;
+    }
+    out << std::left << std::setw(57) << "Total" << std::right << std::setw(12) << total_time << std::endl;
+}
+
 std::string OpenCLContext::OpenCLSource(const std::string& shaderName) {
 #if defined(__ANDROID__) && defined(USE_ASSET_MANAGER)
     return cl_shaders[shaderName];
@@ -158,12 +547,92 @@ void OpenCLContext::handleProgramException(const cl::BuildError& e) {
     }
 }
 
-#ifdef __APPLE__
-static const char* cl_options = "-cl-std=CL1.2 -Werror -cl-fast-relaxed-math -cl-single-precision-constant";
+#ifdef __ANDROID__
+static const char* cl_options =
+    "-cl-std=CL2.0 -Werror -cl-fast-relaxed-math -cl-single-precision-constant -cl-kernel-arg-info";
 #else
-static const char* cl_options = "-cl-std=CL2.0 -Werror -cl-fast-relaxed-math -cl-single-precision-constant";
+// Apple only supports OpenCL 1.2, and it is the version supported by all the runtimes elsewhere (including PoCL)
+static const char* cl_options =
+    "-cl-std=CL1.2 -Werror -cl-fast-relaxed-math -cl-single-precision-constant -cl-kernel-arg-info";
 #endif
 
+// 64 bit FNV-1a hash, stable across runs and platforms
+static uint64_t fnv1aHash(const std::string& data, uint64_t hash = 0xcbf29ce484222325) {
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 0x100000001b3;
+    }
+    return hash;
+}
+
+// Hash of a list of strings, including their lengths so that fields can't bleed into each other
+static uint64_t hashFields(const std::vector<std::string>& fields) {
+    uint64_t hash = fnv1aHash("");
+    for (const auto& field : fields) {
+        hash = fnv1aHash(std::to_string(field.size()) + ":" + field, hash);
+    }
+    return hash;
+}
+
+// Identifies the device, its driver and platform
+static std::vector<std::string> deviceKeyFields(const cl::Device& device) {
+    const cl::Platform platform(device.getInfo<CL_DEVICE_PLATFORM>());
+    return {
+        device.getInfo<CL_DEVICE_NAME>(),
+        device.getInfo<CL_DRIVER_VERSION>(),
+        platform.getInfo<CL_PLATFORM_NAME>(),
+        platform.getInfo<CL_PLATFORM_VERSION>(),
+    };
+}
+
+static std::string hexString(uint64_t value) {
+    std::stringstream result;
+    result << std::hex << std::setw(16) << std::setfill('0') << value;
+    return result.str();
+}
+
+// Cache file name for a program, unique for its source, build options, device, driver and platform
+static std::string programCacheFileName(const std::string& programName, const std::string& source,
+                                        const cl::Device& device) {
+    auto key_fields = deviceKeyFields(device);
+    key_fields.push_back(source);
+    key_fields.push_back(cl_options);
+    return programName + "-" + hexString(hashFields(key_fields)) + ".bin";
+}
+
+// mkdir -p
+static bool makeDirectories(const std::string& path) {
+    for (size_t separator = path.find('/', 1); ; separator = path.find('/', separator + 1)) {
+        const std::string directory = path.substr(0, separator);
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (separator == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+// Write the data to a temporary file and rename it in place, so that concurrent processes never see a partial file
+static void saveCacheFile(const std::string& path, const std::vector<unsigned char>& data) {
+    const std::string temporaryPath = path + ".tmp" + std::to_string(getpid());
+    if (OpenCLContext::saveBinaryFile(temporaryPath, data) != 0 || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR(TAG) << "Couldn't write OpenCL cache file " << path << std::endl;
+        remove(temporaryPath.c_str());
+    }
+}
+
+// The device binary of a program built for the given device
+static std::vector<unsigned char> programBinary(const cl::Program& program, const cl::Device& device) {
+    const auto devices = program.getInfo<CL_PROGRAM_DEVICES>();
+    const auto binaries = program.getInfo<CL_PROGRAM_BINARIES>();
+    for (size_t i = 0; i < devices.size() && i < binaries.size(); i++) {
+        if (devices[i]() == device()) {
+            return binaries[i];
+        }
+    }
+    return std::vector<unsigned char>();
+}
+
 cl::Program OpenCLContext::loadProgram(const std::string& programName, const std::string& shadersRootPath) {
     cl::Program program = _program_cache[programName];
     if (program()) {
@@ -179,13 +648,45 @@ cl::Program OpenCLContext::loadProgram(const std::string& programName, const std
 
         if (!binary.empty()) {
             program = cl::Program(context, {device}, {binary});
-        } else
+            program.build(device, cl_options);
+            _program_cache[programName] = program;
+            return program;
+        }
 #endif
-        {
-            program = cl::Program(OpenCLSource(programName + ".cl"));
+        const std::string source = OpenCLSource(programName + ".cl");
+
+        std::string cachePath;
+        if (!_cacheDirectory.empty() && makeDirectories(_cacheDirectory)) {
+            cachePath = _cacheDirectory + "/" + programCacheFileName(programName, source, device);
+
+            std::ifstream file(cachePath, std::ios::in | std::ios::binary);
+            if (file.is_open()) {
+                std::vector<unsigned char> cachedBinary((std::istreambuf_iterator<char>(file)),
+                                                        std::istreambuf_iterator<char>());
+                try {
+                    program = cl::Program(context, {device}, {cachedBinary});
+                    program.build(device, cl_options);
+                    _program_cache[programName] = program;
+                    return program;
+                } catch (const cl::Error& e) {
+                    // Stale or corrupted binary, rebuild from source and replace it
+                    LOG_INFO(TAG) << "Discarding OpenCL program cache file " << cachePath << ": "
+                                  << clStatusToString(e.err()) << std::endl;
+                    remove(cachePath.c_str());
+                }
+            }
         }
+
+        program = cl::Program(source);
         program.build(device, cl_options);
         _program_cache[programName] = program;
+
+        if (!cachePath.empty()) {
+            const auto binary = programBinary(program, device);
+            if (!binary.empty()) {
+                saveCacheFile(cachePath, binary);
+            }
+        }
         return program;
     } catch (const cl::BuildError& e) {
         handleProgramException(e);
@@ -193,6 +694,27 @@ cl::Program OpenCLContext::loadProgram(const std::string& programName, const std
     }
 }
 
+// Static
+uint64_t OpenCLContext::nextKernelCacheId() {
+    static std::atomic<uint64_t> nextId = 0;
+    return nextId++;
+}
+
+cl::Kernel OpenCLContext::loadKernel(const char* programName, const char* kernelName) {
+    // The lookup compares the names in place, they are only copied when the kernel is created
+    const auto entry = threadKernelCache.find(
+        std::make_tuple(_kernel_cache_id, std::string_view(programName), std::string_view(kernelName)));
+    if (entry != threadKernelCache.end()) {
+        return entry->second;
+    }
+
+    std::lock_guard<std::mutex> guard(_program_cache_mutex);
+    cl::Kernel kernel(loadProgram(programName), kernelName);
+    threadKernelCache.emplace(std::make_tuple(_kernel_cache_id, std::string(programName), std::string(kernelName)),
+                              kernel);
+    return kernel;
+}
+
 // Static
 int OpenCLContext::buildProgram(cl::Program& program) {
     try {
@@ -224,13 +746,10 @@ static std::vector<int> computeDivisors(const size_t val) {
 
 // Compute the squarest workgroup of size <= max_workgroup_size
 // Static
-cl::NDRange OpenCLContext::computeWorkGroupSizes(size_t width, size_t height) {
+cl::NDRange OpenCLContext::computeWorkGroupSizes(size_t width, size_t height, size_t max_workgroup_size) {
     std::vector<int> width_divisors = computeDivisors(width);
     std::vector<int> height_divisors = computeDivisors(height);
 
-    cl::Device d = cl::Device::getDefault();
-    const size_t max_workgroup_size = d.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
-
     int width_divisor = 1;
     int height_divisor = 1;
     while (width_divisor * height_divisor <= max_workgroup_size &&
@@ -260,4 +779,266 @@ cl::NDRange OpenCLContext::computeWorkGroupSizes(size_t width, size_t height) {
     return cl::NDRange(width_divisor, height_divisor);
 }
 
+// Static
+cl::NDRange OpenCLContext::computeWorkGroupSizes(size_t width, size_t height) {
+    static const size_t max_workgroup_size = cl::Device::getDefault().getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    return computeWorkGroupSizes(width, height, max_workgroup_size);
+}
+
+// Images are bucketed by the power of two range of their dimensions
+static int sizeClass(size_t size) { return (int) std::bit_width(size); }
+
+// Kernel properties used to pick work-group sizes, queried once per kernel object
+const OpenCLContext::kernel_info& OpenCLContext::kernelInfo(const cl::Kernel& kernel) {
+    auto entry = _kernel_info.find(kernel());
+    if (entry == _kernel_info.end()) {
+        const cl::Device device = cl::Device::getDefault();
+        const kernel_info info = {
+            kernel.getInfo<CL_KERNEL_FUNCTION_NAME>(),
+            std::min(kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+                     device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>()),
+            kernel.getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device),
+            {},
+        };
+        entry = _kernel_info.emplace(kernel(), info).first;
+        try {
+            const cl_uint arguments = kernel.getInfo<CL_KERNEL_NUM_ARGS>();
+            for (cl_uint i = 0; i < arguments; i++) {
+                entry->second.argumentAccess.push_back(kernel.getArgInfo<CL_KERNEL_ARG_ACCESS_QUALIFIER>(i));
+            }
+        } catch (const cl::Error&) {
+            // Argument info is not available for programs loaded from some binaries
+            entry->second.argumentAccess.clear();
+        }
+    }
+    return entry->second;
+}
+
+std::string OpenCLContext::workGroupSizesPath() {
+    if (_cacheDirectory.empty() || !makeDirectories(_cacheDirectory)) {
+        return "";
+    }
+    return _cacheDirectory + "/workgroups-" + hexString(hashFields(deviceKeyFields(cl::Device::getDefault()))) + ".txt";
+}
+
+// The database is a text file with one "kernel width_class height_class local_width local_height" line per entry
+void OpenCLContext::loadWorkGroupSizes() {
+    if (_work_group_sizes_loaded) {
+        return;
+    }
+    _work_group_sizes_loaded = true;
+
+    std::ifstream file(workGroupSizesPath());
+    std::string name;
+    int width_class, height_class;
+    size_t local_width, local_height;
+    while (file >> name >> width_class >> height_class >> local_width >> local_height) {
+        _work_group_sizes[{name, width_class, height_class}] = cl::NDRange(local_width, local_height);
+    }
+}
+
+void OpenCLContext::saveWorkGroupSizes() {
+    const std::string path = workGroupSizesPath();
+    if (path.empty()) {
+        return;
+    }
+    std::stringstream database;
+    for (const auto& [key, local_size] : _work_group_sizes) {
+        const auto& [name, width_class, height_class] = key;
+        database << name << " " << width_class << " " << height_class << " " << local_size[0] << " " << local_size[1]
+                 << std::endl;
+    }
+    const std::string text = database.str();
+    saveCacheFile(path, std::vector<unsigned char>(text.begin(), text.end()));
+}
+
+cl::NDRange OpenCLContext::localWorkGroupSize(const cl::Kernel& kernel, size_t width, size_t height) {
+    std::lock_guard<std::mutex> guard(_work_group_mutex);
+
+    const auto& info = kernelInfo(kernel);
+    loadWorkGroupSizes();
+    const auto entry = _work_group_sizes.find({info.name, sizeClass(width), sizeClass(height)});
+    if (entry != _work_group_sizes.end()) {
+        return entry->second;
+    }
+
+    // Odd or prime dimensions (crops, pyramid levels) only have small divisors, pad the grid for those
+    const auto exact_size = computeWorkGroupSizes(width, height, info.maxWorkGroupSize);
+    const auto padded_size = computeWorkGroupSizes(std::bit_ceil(std::min(width, (size_t) 32)),
+                                                   std::bit_ceil(std::min(height, (size_t) 32)), info.maxWorkGroupSize);
+    return exact_size[0] * exact_size[1] >= padded_size[0] * padded_size[1] ? exact_size : padded_size;
+}
+
+// Times the kernel with the power of two local sizes that fit the kernel and the grid, preferring multiples of the
+// kernel's preferred work-group size multiple, and records the fastest
+void OpenCLContext::tuneWorkGroupSize(const cl::Kernel& kernel, size_t width, size_t height,
+                                      const std::function<void(const cl::EnqueueArgs&)>& dispatch) {
+    kernel_info info;
+    work_group_key key;
+    {
+        std::lock_guard<std::mutex> guard(_work_group_mutex);
+
+        info = kernelInfo(kernel);
+        key = {info.name, sizeClass(width), sizeClass(height)};
+        loadWorkGroupSizes();
+        if (_work_group_sizes.find(key) != _work_group_sizes.end()) {
+            return;
+        }
+    }
+
+    std::vector<cl::NDRange> candidates;
+    for (bool preferred_only : {true, false}) {
+        for (size_t local_width = 1; local_width <= std::bit_ceil(std::min(width, (size_t) 128)); local_width *= 2) {
+            for (size_t local_height = 1; local_height <= std::bit_ceil(std::min(height, (size_t) 128));
+                 local_height *= 2) {
+                const size_t size = local_width * local_height;
+                if (size <= info.maxWorkGroupSize &&
+                    (!preferred_only || size % info.preferredWorkGroupSizeMultiple == 0)) {
+                    candidates.push_back(cl::NDRange(local_width, local_height));
+                }
+            }
+        }
+        if (!candidates.empty()) {
+            break;
+        }
+    }
+
+    auto queue = cl::CommandQueue::getDefault();
+    queue.finish();
+
+    cl::NDRange best_local_size = computeWorkGroupSizes(width, height, info.maxWorkGroupSize);
+    double best_time = std::numeric_limits<double>::max();
+    for (const auto& local_size : candidates) {
+        try {
+            // Best of three runs, after a warmup run
+            double time = std::numeric_limits<double>::max();
+            for (int run = 0; run < 4; run++) {
+                const auto start = std::chrono::steady_clock::now();
+                dispatch(cl::EnqueueArgs(paddedGlobalSize(width, height, local_size), local_size));
+                queue.finish();
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+                if (run > 0) {
+                    time = std::min(time, std::chrono::duration<double, std::milli>(elapsed).count());
+                }
+            }
+            if (time < best_time) {
+                best_time = time;
+                best_local_size = local_size;
+            }
+        } catch (const cl::Error&) {
+            // Some sizes may exceed the kernel's resources
+            queue.finish();
+        }
+    }
+    LOG_INFO(TAG) << "Tuned " << info.name << " for " << width << "x" << height << ": " << best_local_size[0] << "x"
+                  << best_local_size[1] << " (" << best_time << "ms)" << std::endl;
+
+    std::lock_guard<std::mutex> guard(_work_group_mutex);
+    _work_group_sizes[key] = best_local_size;
+    saveWorkGroupSizes();
+}
+
+// Images created from a buffer (cl_image_buffer_2d) share the buffer's storage: track them as the buffer itself, so that
+// commands using either memory object are ordered with each other
+static cl_mem trackedMemory(cl_mem memory) {
+    cl_mem associated = nullptr;
+    if (clGetMemObjectInfo(memory, CL_MEM_ASSOCIATED_MEMOBJECT, sizeof(associated), &associated, nullptr) ==
+            CL_SUCCESS &&
+        associated != nullptr) {
+        return associated;
+    }
+    return memory;
+}
+
+std::vector<OpenCLContext::memory_access> OpenCLContext::memoryAccesses(const cl::Kernel& kernel,
+                                                                        const std::vector<cl_mem>& arguments) {
+    std::vector<cl_kernel_arg_access_qualifier> argumentAccess;
+    {
+        std::lock_guard<std::mutex> guard(_work_group_mutex);
+        argumentAccess = kernelInfo(kernel).argumentAccess;
+    }
+
+    std::vector<memory_access> accesses;
+    for (size_t i = 0; i < arguments.size(); i++) {
+        if (arguments[i] != nullptr) {
+            // Buffers and arguments without access info may be both read and written
+            const auto access = i < argumentAccess.size() ? argumentAccess[i] : CL_KERNEL_ARG_ACCESS_NONE;
+            accesses.push_back({trackedMemory(arguments[i]), access != CL_KERNEL_ARG_ACCESS_WRITE_ONLY,
+                                access != CL_KERNEL_ARG_ACCESS_READ_ONLY});
+        }
+    }
+    return accesses;
+}
+
+// Reads wait for the last write, writes also wait for the reads since the last write
+std::vector<cl::Event> OpenCLContext::dependencies(const std::vector<memory_access>& accesses) {
+    std::vector<cl::Event> events;
+    for (const auto& access : accesses) {
+        const auto entry = _memory_events.find(access.memory);
+        if (entry == _memory_events.end()) {
+            continue;
+        }
+        if (entry->second.write()) {
+            events.push_back(entry->second.write);
+        }
+        if (access.write) {
+            events.insert(events.end(), entry->second.reads.begin(), entry->second.reads.end());
+        }
+    }
+    return events;
+}
+
+// A dispatch reading memory that it also writes doesn't produce the same result when it's run again
+// Static
+bool OpenCLContext::readsOutput(const std::vector<memory_access>& accesses) {
+    for (const auto& access : accesses) {
+        if (access.write && std::any_of(accesses.begin(), accesses.end(), [&](const memory_access& other) {
+                return other.read && other.memory == access.memory;
+            })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+cl::Event OpenCLContext::enqueueTransfer(
+    const cl::Memory& memory, bool write,
+    const std::function<cl::Event(const std::vector<cl::Event>& dependencies)>& transfer) {
+    std::lock_guard<std::mutex> guard(_memory_events_mutex);
+
+    const std::vector<memory_access> accesses = {{trackedMemory(memory()), /*read=*/!write, write}};
+    cl::Event event = transfer(dependencies(accesses));
+    recordAccesses(accesses, event);
+    // Submit the transfer right away, it may otherwise wait in the queue until the next blocking call
+    cl::CommandQueue::getDefault().flush();
+    return event;
+}
+
+static bool isComplete(const cl::Event& event) {
+    return !event() || event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() == CL_COMPLETE;
+}
+
+void OpenCLContext::recordAccesses(const std::vector<memory_access>& accesses, const cl::Event& event) {
+    for (const auto& access : accesses) {
+        auto& entry = _memory_events[access.memory];
+        if (access.write) {
+            entry.write = event;
+            entry.reads.clear();
+        } else {
+            if (entry.reads.size() > 16) {
+                std::erase_if(entry.reads, isComplete);
+            }
+            entry.reads.push_back(event);
+        }
+    }
+
+    // Forget the memory objects with no pending commands, the handles of released objects can be reused
+    if (_memory_events.size() > 256) {
+        std::erase_if(_memory_events, [](const auto& entry) {
+            const auto& [memory, events] = entry;
+            return isComplete(events.write) && std::all_of(events.reads.begin(), events.reads.end(), isComplete);
+        });
+    }
+}
+
 }  // namespace gls
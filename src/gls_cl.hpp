@@ -13,7 +13,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdlib>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
 
 #ifndef GLS_CL_HPP
 #define GLS_CL_HPP
@@ -40,14 +48,129 @@
 #include <CL/cl_ext.h>
 #include <CL/opencl.hpp>
 
+#else
+
+// Linux and other platforms using the ICD loader. The C headers are set to OpenCL 2.0 only so that the image from
+// buffer queries (CL_DEVICE_IMAGE_PITCH_ALIGNMENT and friends) compile. The C++ wrapper, and so the API actually
+// called, targets OpenCL 1.2, which all runtimes support, PoCL included.
+#define CL_TARGET_OPENCL_VERSION 200
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#define CL_HPP_MINIMUM_OPENCL_VERSION 120
+#define CL_HPP_TARGET_OPENCL_VERSION 120
+#define CL_HPP_USE_CL_IMAGE2D_FROM_BUFFER_KHR true
+
+#include <CL/cl_ext.h>
+#include <CL/opencl.hpp>
+
 #endif
 
 namespace gls {
 
+// Kernel and transfer timeline profiling. When $GLS_CL_PROFILE is set the default queue is created with
+// CL_QUEUE_PROFILING_ENABLE, and the events of all the commands enqueued through OpenCLContext::enqueue and cl_image
+// are recorded. The events are released once their commands complete, keeping the timings of the most recent 256K
+// commands until clear() is called. If $GLS_CL_PROFILE is a file path, the trace is written there and the summary is
+// logged when the OpenCLContext is destroyed.
+class cl_profiler {
+   public:
+    static bool enabled();
+    static void setEnabled(bool enabled);
+
+    static void record(const std::string& name, const char* category, size_t width, size_t height,
+                       const cl::Event& event);
+
+    // Chrome trace event format JSON, for chrome://tracing or Perfetto
+    static void writeTrace(const std::string& path);
+
+    // Execution time statistics per command and image size, slowest first, with the mean wait from enqueue to start
+    static void printSummary(std::ostream& out);
+
+    static void clear();
+};
+
+class cl_image_pool;
+
+#if !defined(__APPLE__) && !defined(__ANDROID__)
+// OpenCL device selection, for the systems with multiple OpenCL platforms and devices: the device with image support
+// matching type and name is selected. Among several matches GPUs are preferred to accelerators and accelerators to
+// CPUs (e.g. PoCL), then the device with most compute units is selected.
+struct cl_device_selector {
+    cl_device_type type = CL_DEVICE_TYPE_ALL;
+    // Case insensitive substring of the device name, platform name or platform vendor, any device if empty
+    std::string name;
+
+    bool matches(const cl::Platform& platform, const cl::Device& device) const;
+
+    // "[gpu|cpu|accelerator|all][:name]" or "name", e.g.: "gpu", "cpu:pocl", "nvidia"
+    static cl_device_selector parse(const std::string& specification);
+
+    // From $GLS_CL_DEVICE, any device if not set
+    static cl_device_selector fromEnvironment();
+};
+#endif
+
 class OpenCLContext {
     cl::Context _clContext;
+    std::unique_ptr<cl_image_pool> _image_pool;
     const std::string _shadersRootPath;
+    std::string _cacheDirectory;
     std::map<std::string, cl::Program> _program_cache;
+    std::mutex _program_cache_mutex;
+    // Identifies this context's entries in the per thread kernel caches, see loadKernel
+    const uint64_t _kernel_cache_id = nextKernelCacheId();
+
+    static uint64_t nextKernelCacheId();
+
+    struct kernel_info {
+        std::string name;
+        size_t maxWorkGroupSize;
+        size_t preferredWorkGroupSizeMultiple;
+        // Access qualifiers of the kernel arguments, empty if the implementation doesn't report them
+        std::vector<cl_kernel_arg_access_qualifier> argumentAccess;
+    };
+    // Work-group size database: (kernel name, width class, height class) -> local size
+    typedef std::tuple<std::string, int, int> work_group_key;
+    std::map<work_group_key, cl::NDRange> _work_group_sizes;
+    std::map<cl_kernel, kernel_info> _kernel_info;
+    bool _work_group_sizes_loaded = false;
+    bool _tune_work_group_sizes = getenv("GLS_CL_TUNE_WORK_GROUPS") != nullptr;
+    std::mutex _work_group_mutex;
+
+    const kernel_info& kernelInfo(const cl::Kernel& kernel);
+    std::string workGroupSizesPath();
+    void loadWorkGroupSizes();
+    void saveWorkGroupSizes();
+    void tuneWorkGroupSize(const cl::Kernel& kernel, size_t width, size_t height,
+                           const std::function<void(const cl::EnqueueArgs&)>& dispatch);
+
+    // Dependency tracking: the last command writing each memory object and the commands reading it since
+    struct memory_events {
+        cl::Event write;
+        std::vector<cl::Event> reads;
+    };
+    struct memory_access {
+        cl_mem memory;
+        bool read;
+        bool write;
+    };
+    std::map<cl_mem, memory_events> _memory_events;
+    std::mutex _memory_events_mutex;
+    bool _out_of_order_queue = false;
+
+    void createCommandQueue();
+    std::vector<memory_access> memoryAccesses(const cl::Kernel& kernel, const std::vector<cl_mem>& arguments);
+    std::vector<cl::Event> dependencies(const std::vector<memory_access>& accesses);
+    static bool readsOutput(const std::vector<memory_access>& accesses);
+    void recordAccesses(const std::vector<memory_access>& accesses, const cl::Event& event);
+
+    template <typename T>
+    static cl_mem memoryObject(const T& argument) {
+        if constexpr (std::is_base_of_v<cl::Memory, T>) {
+            return argument();
+        } else {
+            return nullptr;
+        }
+    }
 #if defined(__ANDROID__) && defined(USE_ASSET_MANAGER)
     std::map<std::string, std::string> cl_shaders;
     std::map<std::string, std::vector<unsigned char>> cl_bytecode;
@@ -56,7 +179,16 @@ class OpenCLContext {
    public:
     OpenCLContext(const std::string& shadersRootPath = "", bool quiet = false);
 
+#if !defined(__APPLE__) && !defined(__ANDROID__)
+    OpenCLContext(const std::string& shadersRootPath, const cl_device_selector& selector, bool quiet = false);
+#endif
+
+    ~OpenCLContext();
+
     cl::Context clContext() { return _clContext; }
+
+    // Recycles the temporary images of the processing pipeline, see gls_cl_image.hpp
+    cl_image_pool& imagePool() { return *_image_pool; }
     const std::string& shadersRootPath() { return _shadersRootPath; }
 
 #if defined(__ANDROID__) && defined(USE_ASSET_MANAGER)
@@ -69,6 +201,86 @@ class OpenCLContext {
 
     cl::Program loadProgram(const std::string& programName, const std::string& shadersRootPath = "");
 
+    // Kernels are created once per program, kernel name and calling thread, and reused for every dispatch. A
+    // cl::Kernel holds its argument values, so a kernel object is never shared between threads. The kernels live in a
+    // thread local cache, released when the thread exits, and the lookup doesn't take any lock.
+    cl::Kernel loadKernel(const char* programName, const char* kernelName);
+
+    template <typename... Ts>
+    cl::KernelFunctor<Ts...> loadKernelFunctor(const char* programName, const char* kernelName) {
+        return cl::KernelFunctor<Ts...>(loadKernel(programName, kernelName));
+    }
+
+    // Programs built from source are cached on disk as device binaries, keyed by source, build options, device,
+    // driver and platform. The work-group size database lives in the same directory. It defaults to
+    // $GLS_CL_CACHE_DIR, or to ~/.cache/climage/cl off Android. An empty path disables the cache.
+    void setCacheDirectory(const std::string& path) { _cacheDirectory = path; }
+    const std::string& cacheDirectory() const { return _cacheDirectory; }
+
+    // With tuning enabled (or $GLS_CL_TUNE_WORK_GROUPS set), the first dispatch of each kernel for an image size
+    // class times the candidate local sizes and records the fastest in a per-device database. Later runs dispatch
+    // with the recorded sizes without tuning. Tuning runs a kernel several times, so dispatches reading memory they
+    // also write (in place kernels) are not tuned and use the recorded or the default size.
+    void setWorkGroupSizeTuning(bool tune) { _tune_work_group_sizes = tune; }
+
+    // Local work-group size for a dispatch of kernel over a width x height grid: the tuned size from the
+    // database when there is one, otherwise the squarest divisor of the grid, or the squarest power of two size
+    // when the grid dimensions don't have large enough divisors.
+    cl::NDRange localWorkGroupSize(const cl::Kernel& kernel, size_t width, size_t height);
+
+    // The grid rounded up to a multiple of the work-group size
+    static cl::NDRange paddedGlobalSize(size_t width, size_t height, const cl::NDRange& local_size) {
+        return cl::NDRange((width + local_size[0] - 1) / local_size[0] * local_size[0],
+                           (height + local_size[1] - 1) / local_size[1] * local_size[1]);
+    }
+
+    // The global range is padded to full work-groups, kernels dispatched this way return early for the
+    // work-items that fall outside of their image.
+    cl::EnqueueArgs buildEnqueueArgs(const cl::Kernel& kernel, size_t width, size_t height) {
+        const cl::NDRange local_size = localWorkGroupSize(kernel, width, height);
+        return cl::EnqueueArgs(paddedGlobalSize(width, height, local_size), local_size);
+    }
+
+    cl::EnqueueArgs buildEnqueueArgs(const cl::Kernel& kernel, size_t width, size_t height,
+                                     const std::vector<cl::Event>& dependencies) {
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+        const cl::NDRange local_size = localWorkGroupSize(kernel, width, height);
+        return cl::EnqueueArgs(queue, dependencies, paddedGlobalSize(width, height, local_size), local_size);
+    }
+
+    // The default queue executes out of order when the device supports it ($GLS_CL_IN_ORDER_QUEUE disables it).
+    // Commands are then only ordered by their dependencies: host transfers of cl_image are fenced with barriers,
+    // and enqueue makes each dispatch wait for the earlier commands writing its input images, and for the earlier
+    // commands reading or writing its output images, so that independent kernels can overlap.
+    bool outOfOrderQueue() const { return _out_of_order_queue; }
+
+    // Dispatches kernel over a width x height grid
+    template <typename... Ts>
+    cl::Event enqueue(cl::KernelFunctor<Ts...>& kernel, size_t width, size_t height,
+                      std::type_identity_t<Ts>... args) {
+        const auto accesses = memoryAccesses(kernel.getKernel(), {memoryObject(args)...});
+        if (_tune_work_group_sizes && !readsOutput(accesses)) {
+            tuneWorkGroupSize(kernel.getKernel(), width, height,
+                              [&](const cl::EnqueueArgs& enqueueArgs) { kernel(enqueueArgs, args...); });
+        }
+
+        std::lock_guard<std::mutex> guard(_memory_events_mutex);
+
+        cl::Event event = kernel(buildEnqueueArgs(kernel.getKernel(), width, height, dependencies(accesses)), args...);
+        recordAccesses(accesses, event);
+        if (cl_profiler::enabled()) {
+            cl_profiler::record(kernel.getKernel().template getInfo<CL_KERNEL_FUNCTION_NAME>(), "kernel", width,
+                                height, event);
+        }
+        return event;
+    }
+
+    // Enqueues a non blocking host transfer on memory, ordered with the kernels and the other transfers using it by the
+    // same dependency tracking as enqueue(). write: the transfer modifies the device memory (uploads, writable maps).
+    // transfer enqueues the command after the given dependencies and returns its event.
+    cl::Event enqueueTransfer(const cl::Memory& memory, bool write,
+                              const std::function<cl::Event(const std::vector<cl::Event>& dependencies)>& transfer);
+
     static int saveBinaryFile(const std::string& path, const std::vector<unsigned char>& binary);
 
     static int buildProgram(cl::Program& program);
@@ -77,6 +289,8 @@ class OpenCLContext {
 
     static cl::NDRange computeWorkGroupSizes(size_t width, size_t height);
 
+    static cl::NDRange computeWorkGroupSizes(size_t width, size_t height, size_t max_workgroup_size);
+
     inline static cl::EnqueueArgs buildEnqueueArgs(size_t width, size_t height) {
         cl::NDRange global_workgroup_size = cl::NDRange(width, height);
         cl::NDRange local_workgroup_size = computeWorkGroupSizes(width, height);
@@ -16,13 +16,24 @@
 #ifndef CL_IMAGE_H
 #define CL_IMAGE_H
 
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "gls_cl.hpp"
 #include "gls_image.hpp"
 
 namespace gls {
 
+// The default queue may execute out of order: host transfers are fenced with barriers, so that they are ordered with
+// respect to all the commands enqueued before them (and after them, for the non blocking ones)
+inline void enqueueBarrier() { cl::CommandQueue::getDefault().enqueueBarrierWithWaitList(); }
+
 template <typename T>
 requires (T::channels == 1 || T::channels == 2 || T::channels == 4)
 class cl_image : public basic_image<T> {
@@ -56,6 +67,10 @@ class cl_image_2d : public cl_image<T> {
         : cl_image<T>(other.width, other.height),
           _payload(buildPayload(context, other.width, other.height, other.stride, other.pixels().data())) {}
 
+    // Wraps an existing image object, which must have the pixel format of T and the given size
+    cl_image_2d(const cl::Image2D& image, int _width, int _height)
+        : cl_image<T>(_width, _height), _payload(std::make_unique<payload>(payload{image})) {}
+
     virtual ~cl_image_2d() {}
 
     static inline std::unique_ptr<payload> buildPayload(cl::Context context, int width, int height, int stride, T* data = nullptr) {
@@ -69,75 +84,157 @@ class cl_image_2d : public cl_image<T> {
     }
 
     inline typename gls::image<T>::unique_ptr toImage() const {
-        auto image = std::make_unique<gls::image<T>>(gls::image<T>::width, gls::image<T>::height);
+        auto image = std::make_unique<gls::image<T>>(this->width, this->height);
         copyPixelsTo(image.get());
         return image;
     }
 
     void copyPixelsFrom(const image<T>& other) const {
-        assert(other.width == image<T>::width && other.height == image<T>::height);
-        cl::enqueueWriteImage(_payload->image, true, {0, 0, 0}, {(size_t)image<T>::width, (size_t)image<T>::height, 1},
-                              image<T>::pixel_size * other.stride, 0, other.pixels().data());
+        assert(other.width == this->width && other.height == this->height);
+        enqueueBarrier();
+        cl::Event event;
+        cl::enqueueWriteImage(_payload->image, true, {0, 0, 0}, {(size_t)this->width, (size_t)this->height, 1},
+                              image<T>::pixel_size * other.stride, 0, other.pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsFrom", "transfer", this->width, this->height, event);
     }
 
     void copyPixelsTo(image<T>* other) const {
-        assert(other->width == image<T>::width && other->height == image<T>::height);
+        assert(other->width == this->width && other->height == this->height);
+        enqueueBarrier();
+        cl::Event event;
         cl::enqueueReadImage(_payload->image, CL_TRUE, {0, 0, 0},
-                             {(size_t)image<T>::width, (size_t)image<T>::height, 1},
-                             image<T>::pixel_size * other->stride, 0, other->pixels().data());
+                             {(size_t)this->width, (size_t)this->height, 1},
+                             image<T>::pixel_size * other->stride, 0, other->pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsTo", "transfer", this->width, this->height, event);
+    }
+
+    // Non blocking transfers: they are only ordered after the dependencies, and the host memory must remain valid
+    // until the returned event completes. See OpenCLContext::enqueueTransfer to order them with the kernels.
+
+    cl::Event copyPixelsFromAsync(const image<T>& other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other.width == this->width && other.height == this->height);
+        cl::Event event;
+        cl::enqueueWriteImage(_payload->image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->height, 1},
+                              image<T>::pixel_size * other.stride, 0, other.pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsFromAsync", "transfer", this->width, this->height, event);
+        return event;
+    }
+
+    cl::Event copyPixelsToAsync(image<T>* other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other->width == this->width && other->height == this->height);
+        cl::Event event;
+        cl::enqueueReadImage(_payload->image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->height, 1},
+                             image<T>::pixel_size * other->stride, 0, other->pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsToAsync", "transfer", this->width, this->height, event);
+        return event;
+    }
+
+    // The mapped pixels are valid once the event returned in mapEvent completes
+    image<T> mapImageAsync(cl::Event* mapEvent, const std::vector<cl::Event>& dependencies = {},
+                           cl_map_flags flags = CL_MAP_READ | CL_MAP_WRITE) const {
+        size_t row_pitch;
+        size_t slice_pitch;
+        T* image_data = (T*)cl::CommandQueue::getDefault().enqueueMapImage(
+            _payload->image, CL_FALSE, flags, {0, 0, 0}, {(size_t)this->width, (size_t)this->height, 1}, &row_pitch,
+            &slice_pitch, &dependencies, mapEvent);
+        assert(image_data != nullptr);
+        cl_profiler::record("mapImageAsync", "transfer", this->width, this->height, *mapEvent);
+
+        size_t stride = row_pitch / image<T>::pixel_size;
+        size_t data_size = stride * this->height;
+        return gls::image(this->width, this->height, (int) stride, std::span<T>(image_data, data_size));
+    }
+
+    cl::Event unmapImageAsync(const image<T>& mappedImage, const std::vector<cl::Event>& dependencies = {}) const {
+        cl::Event event;
+        cl::enqueueUnmapMemObject(_payload->image, (void*)mappedImage[0], &dependencies, &event);
+        cl_profiler::record("unmapImageAsync", "transfer", this->width, this->height, event);
+        return event;
     }
 
     virtual image<T> mapImage() const {
         size_t row_pitch;
         size_t slice_pitch;
         cl::CommandQueue queue = cl::CommandQueue::getDefault();
+        queue.enqueueBarrierWithWaitList();
+        cl::Event event;
         T* image_data =
             (T*)queue.enqueueMapImage(_payload->image, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, {0, 0, 0},
-                                      {(size_t)image<T>::width, (size_t)image<T>::height, 1}, &row_pitch, &slice_pitch);
+                                      {(size_t)this->width, (size_t)this->height, 1}, &row_pitch, &slice_pitch,
+                                      nullptr, &event);
         assert(image_data != nullptr);
+        cl_profiler::record("mapImage", "transfer", this->width, this->height, event);
 
         size_t stride = row_pitch / image<T>::pixel_size;
-        size_t data_size = stride * image<T>::height;
-        return gls::image(image<T>::width, image<T>::height, (int) stride, std::span<T>(image_data, data_size));
+        size_t data_size = stride * this->height;
+        return gls::image(this->width, this->height, (int) stride, std::span<T>(image_data, data_size));
     }
 
-    void unmapImage(const image<T>& mappedImage) const { cl::enqueueUnmapMemObject(_payload->image, (void*)mappedImage[0]); }
+    virtual void unmapImage(const image<T>& mappedImage) const {
+        cl::Event event;
+        cl::enqueueUnmapMemObject(_payload->image, (void*)mappedImage[0], nullptr, &event);
+        enqueueBarrier();
+        cl_profiler::record("unmapImage", "transfer", this->width, this->height, event);
+    }
 
     cl::Image2D getImage2D() const { return _payload->image; }
 };
 
+// A 2D image backed by a buffer in host accessible memory (CL_MEM_ALLOC_HOST_PTR), usable both as an image and as a
+// buffer. Rows are padded to the device's image pitch alignment. On unified memory devices mapping is zero-copy.
+// OpenCLContext tracks the dependencies of the image and of its buffer as a single memory object.
 template <typename T>
 class cl_image_buffer_2d : public cl_image_2d<T> {
-   private:
-    struct payload : public cl_image_2d<T>::payload {
-        const cl::Buffer buffer;
-    };
+    const int _pitch;
+    const cl::Buffer _buffer;
+
+    cl_image_buffer_2d(cl::Context context, int _width, int _height, int pitch, cl::Buffer buffer)
+        : cl_image_2d<T>(context, _width, _height,
+                         std::make_unique<typename cl_image_2d<T>::payload>(typename cl_image_2d<T>::payload{
+                             cl::Image2D(context, cl_image<T>::ImageFormat(), buffer, _width, _height,
+                                         pitch * cl_image<T>::pixel_size)})),
+          _pitch(pitch),
+          _buffer(buffer) {}
 
    public:
+    typedef std::unique_ptr<cl_image_buffer_2d<T>> unique_ptr;
+
     cl_image_buffer_2d(cl::Context context, int _width, int _height)
-        : cl_image_2d<T>(context, _width, _height, buildPayload(context, _width, _height)) {}
+        : cl_image_buffer_2d(context, _width, _height, rowPitch(_width),
+                             cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                        (size_t) rowPitch(_width) * _height * cl_image<T>::pixel_size)) {}
+
+    // Row pitch in pixels: CL_DEVICE_IMAGE_PITCH_ALIGNMENT is expressed in pixels, zero if images from buffers are
+    // not supported
+    static int rowPitch(int width) {
+        const int alignment =
+            std::max((int) cl::Device::getDefault().getInfo<CL_DEVICE_IMAGE_PITCH_ALIGNMENT>(), 1);
+        return alignment * ((width + alignment - 1) / alignment);
+    }
 
-    static inline std::unique_ptr<payload> buildPayload(cl::Context context, int width, int height) {
-        const int pitch_alignment = cl::Device::getDefault().getInfo<CL_DEVICE_IMAGE_PITCH_ALIGNMENT>();
-        const int pitch = pitch_alignment * ((width * sizeof(T) + pitch_alignment - 1) / pitch_alignment) / sizeof(T);
+    int pitch() const { return _pitch; }
 
-        // TODO: this is too strong of an assumption
-        assert(width == pitch);
+    image<T> mapImage() const override {
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+        queue.enqueueBarrierWithWaitList();
+        const size_t data_size = (size_t) _pitch * this->height;
+        cl::Event event;
+        T* image_data = (T*)queue.enqueueMapBuffer(_buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                                                   data_size * cl_image<T>::pixel_size, nullptr, &event);
+        assert(image_data != nullptr);
+        cl_profiler::record("mapImage", "transfer", this->width, this->height, event);
 
-        auto buffer = cl::Buffer(context, CL_MEM_READ_WRITE, pitch * height * sizeof(T));
-        auto image = cl::Image2D(context, cl_image<T>::ImageFormat(), buffer, width, height, pitch * sizeof(T));
-        return std::make_unique<payload>(payload{{image}, buffer});
+        return gls::image(this->width, this->height, _pitch, std::span<T>(image_data, data_size));
     }
 
-    image<T> mapImage() override {
-        size_t pixel_count = image<T>::width * image<T>::height;
-        T* image_data =
-            cl::enqueueMapBuffer(getBuffer(), true, CL_MAP_READ | CL_MAP_WRITE, 0, image<T>::pixel_size * pixel_count);
-
-        return gls::image(image<T>::width, image<T>::height, std::span<T>(image_data, pixel_count));
+    void unmapImage(const image<T>& mappedImage) const override {
+        cl::Event event;
+        cl::enqueueUnmapMemObject(_buffer, (void*)mappedImage[0], nullptr, &event);
+        enqueueBarrier();
+        cl_profiler::record("unmapImage", "transfer", this->width, this->height, event);
     }
 
-    cl::Buffer getBuffer() const { return static_cast<const payload*>(this->_payload.get())->buffer; }
+    cl::Buffer getBuffer() const { return _buffer; }
 };
 
 template <typename T>
@@ -155,25 +252,53 @@ class cl_image_3d : public cl_image<T> {
     }
 
     inline typename gls::image<T>::unique_ptr toImage() const {
-        auto image = std::make_unique<gls::image<T>>(gls::image<T>::width, gls::image<T>::height);
+        auto image = std::make_unique<gls::image<T>>(this->width, this->height);
         copyPixelsTo(image.get());
         return image;
     }
 
     void copyPixelsFrom(const image<T>& other) const {
-        assert(other.width == image<T>::width && other.height == image<T>::height);
-        size_t depth = image<T>::height / image<T>::width;
-        cl::enqueueWriteImage(_image, true, {0, 0, 0}, {(size_t)image<T>::width, (size_t)image<T>::width, depth},
-                              image<T>::pixel_size * image<T>::width,
-                              image<T>::width * image<T>::width * image<T>::pixel_size, other.pixels().data());
+        assert(other.width == this->width && other.height == this->height);
+        size_t depth = this->height / this->width;
+        enqueueBarrier();
+        cl::Event event;
+        cl::enqueueWriteImage(_image, true, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                              image<T>::pixel_size * this->width,
+                              this->width * this->width * image<T>::pixel_size, other.pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsFrom", "transfer", this->width, this->height, event);
     }
 
     void copyPixelsTo(image<T>* other) const {
-        assert(other->width == image<T>::width && other->height == image<T>::height);
-        size_t depth = image<T>::height / image<T>::width;
-        cl::enqueueReadImage(_image, true, {0, 0, 0}, {(size_t)image<T>::width, (size_t)image<T>::width, depth},
-                             image<T>::pixel_size * image<T>::width,
-                             image<T>::width * image<T>::width * image<T>::pixel_size, other->pixels().data());
+        assert(other->width == this->width && other->height == this->height);
+        size_t depth = this->height / this->width;
+        enqueueBarrier();
+        cl::Event event;
+        cl::enqueueReadImage(_image, true, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                             image<T>::pixel_size * this->width,
+                             this->width * this->width * image<T>::pixel_size, other->pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsTo", "transfer", this->width, this->height, event);
+    }
+
+    cl::Event copyPixelsFromAsync(const image<T>& other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other.width == this->width && other.height == this->height);
+        size_t depth = this->height / this->width;
+        cl::Event event;
+        cl::enqueueWriteImage(_image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                              image<T>::pixel_size * this->width, this->width * this->width * image<T>::pixel_size,
+                              other.pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsFromAsync", "transfer", this->width, this->height, event);
+        return event;
+    }
+
+    cl::Event copyPixelsToAsync(image<T>* other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other->width == this->width && other->height == this->height);
+        size_t depth = this->height / this->width;
+        cl::Event event;
+        cl::enqueueReadImage(_image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                             image<T>::pixel_size * this->width, this->width * this->width * image<T>::pixel_size,
+                             other->pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsToAsync", "transfer", this->width, this->height, event);
+        return event;
     }
 
     static inline cl::Image3D buildImage(cl::Context context, int width, int height) {
@@ -199,25 +324,53 @@ class cl_image_2d_array : public cl_image<T> {
     }
 
     inline typename gls::image<T>::unique_ptr toImage() const {
-        auto image = std::make_unique<gls::image<T>>(gls::image<T>::width, gls::image<T>::height);
+        auto image = std::make_unique<gls::image<T>>(this->width, this->height);
         copyPixelsTo(image.get());
         return image;
     }
 
     void copyPixelsFrom(const image<T>& other) const {
-        assert(other.width == image<T>::width && other.height == image<T>::height);
-        size_t depth = image<T>::height / image<T>::width;
-        cl::enqueueWriteImage(_image, true, {0, 0, 0}, {(size_t)image<T>::width, (size_t)image<T>::width, depth},
-                              image<T>::pixel_size * image<T>::width,
-                              image<T>::width * image<T>::width * image<T>::pixel_size, other.pixels().data());
+        assert(other.width == this->width && other.height == this->height);
+        size_t depth = this->height / this->width;
+        enqueueBarrier();
+        cl::Event event;
+        cl::enqueueWriteImage(_image, true, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                              image<T>::pixel_size * this->width,
+                              this->width * this->width * image<T>::pixel_size, other.pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsFrom", "transfer", this->width, this->height, event);
     }
 
     void copyPixelsTo(image<T>* other) const {
-        assert(other->width == image<T>::width && other->height == image<T>::height);
-        size_t depth = image<T>::height / image<T>::width;
-        cl::enqueueReadImage(_image, true, {0, 0, 0}, {(size_t)image<T>::width, (size_t)image<T>::width, depth},
-                             image<T>::pixel_size * image<T>::width,
-                             image<T>::width * image<T>::width * image<T>::pixel_size, other->pixels().data());
+        assert(other->width == this->width && other->height == this->height);
+        size_t depth = this->height / this->width;
+        enqueueBarrier();
+        cl::Event event;
+        cl::enqueueReadImage(_image, true, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                             image<T>::pixel_size * this->width,
+                             this->width * this->width * image<T>::pixel_size, other->pixels().data(), nullptr, &event);
+        cl_profiler::record("copyPixelsTo", "transfer", this->width, this->height, event);
+    }
+
+    cl::Event copyPixelsFromAsync(const image<T>& other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other.width == this->width && other.height == this->height);
+        size_t depth = this->height / this->width;
+        cl::Event event;
+        cl::enqueueWriteImage(_image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                              image<T>::pixel_size * this->width, this->width * this->width * image<T>::pixel_size,
+                              other.pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsFromAsync", "transfer", this->width, this->height, event);
+        return event;
+    }
+
+    cl::Event copyPixelsToAsync(image<T>* other, const std::vector<cl::Event>& dependencies = {}) const {
+        assert(other->width == this->width && other->height == this->height);
+        size_t depth = this->height / this->width;
+        cl::Event event;
+        cl::enqueueReadImage(_image, CL_FALSE, {0, 0, 0}, {(size_t)this->width, (size_t)this->width, depth},
+                             image<T>::pixel_size * this->width, this->width * this->width * image<T>::pixel_size,
+                             other->pixels().data(), &dependencies, &event);
+        cl_profiler::record("copyPixelsToAsync", "transfer", this->width, this->height, event);
+        return event;
     }
 
     static inline cl::Image2DArray buildImage(cl::Context context, int width, int height) {
@@ -291,6 +444,134 @@ inline cl::ImageFormat cl_image<gls::rgba_pixel_fp16>::ImageFormat() {
 }
 #endif
 
+// Recycles the device memory of 2D images: images are handed out as scoped leases and, when the lease goes out of
+// scope, the image goes back to the pool to serve the next request with the same channel order, data type and size.
+// A recycled image keeps its contents, and its previous readers and writers are still tracked by the OpenCLContext's
+// dependency tracking, so kernels writing to it wait for the commands of the previous lease.
+// The pool must outlive its leases.
+class cl_image_pool {
+   public:
+    struct statistics {
+        size_t allocations = 0;  // Images created by the pool
+        size_t reuses = 0;       // Leases served by a recycled image
+        size_t leased_images = 0;
+        size_t leased_bytes = 0;
+        size_t pooled_images = 0;  // Images waiting in the pool
+        size_t pooled_bytes = 0;
+        size_t high_watermark_bytes = 0;  // Peak of leased_bytes + pooled_bytes
+    };
+
+    template <typename T>
+    class lease {
+        cl_image_pool* _pool;
+        std::unique_ptr<cl_image_2d<T>> _image;
+
+       public:
+        lease(cl_image_pool* pool, std::unique_ptr<cl_image_2d<T>> image) : _pool(pool), _image(std::move(image)) {}
+
+        lease(lease&& other) = default;
+        lease& operator=(lease&& other) {
+            if (this != &other) {
+                release();
+                _pool = other._pool;
+                _image = std::move(other._image);
+            }
+            return *this;
+        }
+
+        lease(const lease&) = delete;
+        lease& operator=(const lease&) = delete;
+
+        ~lease() { release(); }
+
+        // Returns the image to the pool, the lease is empty afterwards
+        void release() {
+            if (_image) {
+                _pool->recycle(key<T>(_image->width, _image->height), _image->getImage2D(), byteSize<T>(*_image));
+                _image.reset();
+            }
+        }
+
+        cl_image_2d<T>* get() const { return _image.get(); }
+        cl_image_2d<T>& operator*() const { return *_image; }
+        cl_image_2d<T>* operator->() const { return _image.get(); }
+    };
+
+    explicit cl_image_pool(cl::Context context) : _context(context) {}
+
+    template <typename T>
+    lease<T> acquire(int width, int height) {
+        const auto image_key = key<T>(width, height);
+        const size_t bytes = (size_t) width * height * cl_image<T>::pixel_size;
+        {
+            std::lock_guard<std::mutex> guard(_mutex);
+            auto entry = _free_images.find(image_key);
+            if (entry != _free_images.end() && !entry->second.empty()) {
+                cl::Image2D image = entry->second.back();
+                entry->second.pop_back();
+                _statistics.reuses++;
+                _statistics.pooled_images--;
+                _statistics.pooled_bytes -= bytes;
+                _statistics.leased_images++;
+                _statistics.leased_bytes += bytes;
+                return lease<T>(this, std::make_unique<cl_image_2d<T>>(image, width, height));
+            }
+        }
+
+        auto image = std::make_unique<cl_image_2d<T>>(_context, width, height);
+
+        std::lock_guard<std::mutex> guard(_mutex);
+        _statistics.allocations++;
+        _statistics.leased_images++;
+        _statistics.leased_bytes += bytes;
+        _statistics.high_watermark_bytes =
+            std::max(_statistics.high_watermark_bytes, _statistics.leased_bytes + _statistics.pooled_bytes);
+        return lease<T>(this, std::move(image));
+    }
+
+    statistics getStatistics() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        return _statistics;
+    }
+
+    // Releases the device memory of the images waiting in the pool
+    void trim() {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _free_images.clear();
+        _statistics.pooled_images = 0;
+        _statistics.pooled_bytes = 0;
+    }
+
+   private:
+    // (channel order, channel data type, width, height)
+    typedef std::tuple<cl_channel_order, cl_channel_type, int, int> image_key;
+
+    cl::Context _context;
+    std::map<image_key, std::vector<cl::Image2D>> _free_images;
+    statistics _statistics;
+    std::mutex _mutex;
+
+    template <typename T>
+    static image_key key(int width, int height) {
+        const cl::ImageFormat format = cl_image<T>::ImageFormat();
+        return {format.image_channel_order, format.image_channel_data_type, width, height};
+    }
+
+    template <typename T>
+    static size_t byteSize(const cl_image_2d<T>& image) {
+        return (size_t) image.width * image.height * cl_image<T>::pixel_size;
+    }
+
+    void recycle(const image_key& image_key, const cl::Image2D& image, size_t bytes) {
+        std::lock_guard<std::mutex> guard(_mutex);
+        _free_images[image_key].push_back(image);
+        _statistics.leased_images--;
+        _statistics.leased_bytes -= bytes;
+        _statistics.pooled_images++;
+        _statistics.pooled_bytes += bytes;
+    }
+};
+
 }  // namespace gls
 
 #endif /* CL_IMAGE_H */
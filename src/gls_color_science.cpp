@@ -28,10 +28,7 @@
 #include <float.h>
 #include <math.h>
 
-/* linear interpolation function, is 'a' when c == 0.0 and 'b' when c == 1.0 */
-inline float lerp(float a, float b, float c) {
-    return (b - a) * c + a;
-}
+#include <cmath>
 
 typedef struct UVT {
     float  u;
@@ -114,7 +111,7 @@ float XYZtoCorColorTemp(const float xyz[3]) {
     di = di / sqrt(1.0 + uvt[idx    ].t * uvt[idx    ].t);
     dm = dm / sqrt(1.0 + uvt[idx - 1].t * uvt[idx - 1].t);
     float p = dm / (dm - di);     /* p = interpolation parameter, 0.0 : i-1, 1.0 : i */
-    p = 1.0 / (lerp(rt[idx - 1], rt[idx], p));
+    p = 1.0 / (std::lerp(rt[idx - 1], rt[idx], p));
 
     return p;
 }
@@ -56,6 +56,14 @@
 
 #include "gls_dng_lossless_jpeg.hpp"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 /*****************************************************************************/
 
 namespace gls {
@@ -2143,6 +2151,107 @@ void dng_lossless_decoder::FinishRead() { DecodeImage(); }
 
 /*****************************************************************************/
 
+#if defined(__AVX2__) || defined(__SSE4_1__) || defined(__aarch64__)
+#define GLS_SIMD_ENCODE 1
+#endif
+
+// Predictor differences of a row of contiguous interleaved samples, each predicted by the previous
+// sample of the same channel. Processes samples from 'start' (>= channels) on, returns the index of
+// the first sample left for the scalar code.
+
+#if defined(__AVX2__)
+static uint32_t rowDifferencesSIMD(const uint16_t* src, int16_t* diffs, uint32_t start,
+                                   uint32_t count, uint32_t channels) {
+    uint32_t i = start;
+    for (; i + 16 <= count; i += 16) {
+        __m256i pixel = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i predictor = _mm256_loadu_si256((const __m256i*)(src + i - channels));
+        _mm256_storeu_si256((__m256i*)(diffs + i), _mm256_sub_epi16(pixel, predictor));
+    }
+    return i;
+}
+#elif defined(__SSE4_1__)
+static uint32_t rowDifferencesSIMD(const uint16_t* src, int16_t* diffs, uint32_t start,
+                                   uint32_t count, uint32_t channels) {
+    uint32_t i = start;
+    for (; i + 8 <= count; i += 8) {
+        __m128i pixel = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i predictor = _mm_loadu_si128((const __m128i*)(src + i - channels));
+        _mm_storeu_si128((__m128i*)(diffs + i), _mm_sub_epi16(pixel, predictor));
+    }
+    return i;
+}
+#elif defined(__aarch64__)
+static uint32_t rowDifferencesSIMD(const uint16_t* src, int16_t* diffs, uint32_t start,
+                                   uint32_t count, uint32_t channels) {
+    uint32_t i = start;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t pixel = vld1q_u16(src + i);
+        uint16x8_t predictor = vld1q_u16(src + i - channels);
+        vst1q_s16(diffs + i, vreinterpretq_s16_u16(vsubq_u16(pixel, predictor)));
+    }
+    return i;
+}
+#endif
+
+// Huffman categories (number of bits of the magnitude) of the differences, per section F.1.2.1.
+// The magnitude of -32768 wraps to 0x8000 in 16 bits, which read as unsigned has the expected 16 bits.
+// Returns the index of the first difference left for the scalar code.
+
+#if defined(__AVX2__)
+static uint32_t diffCategoriesSIMD(const int16_t* diffs, uint8_t* categories, uint32_t count) {
+    const __m256i bias = _mm256_set1_epi32(126);
+    const __m256i zero = _mm256_setzero_si256();
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i magnitude = _mm256_abs_epi16(_mm256_loadu_si256((const __m256i*)(diffs + i)));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(magnitude));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(magnitude, 1));
+        // The exponent of the (exact) float conversion is the position of the leading one
+        lo = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(lo)), 23);
+        hi = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(hi)), 23);
+        lo = _mm256_max_epi32(_mm256_sub_epi32(lo, bias), zero);
+        hi = _mm256_max_epi32(_mm256_sub_epi32(hi, bias), zero);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+        _mm_storeu_si128((__m128i*)(categories + i),
+                         _mm_packus_epi16(_mm256_castsi256_si128(packed),
+                                          _mm256_extracti128_si256(packed, 1)));
+    }
+    return i;
+}
+#elif defined(__SSE4_1__)
+static uint32_t diffCategoriesSIMD(const int16_t* diffs, uint8_t* categories, uint32_t count) {
+    const __m128i bias = _mm_set1_epi32(126);
+    const __m128i zero = _mm_setzero_si128();
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i magnitude = _mm_abs_epi16(_mm_loadu_si128((const __m128i*)(diffs + i)));
+        __m128i lo = _mm_cvtepu16_epi32(magnitude);
+        __m128i hi = _mm_unpackhi_epi16(magnitude, zero);
+        // The exponent of the (exact) float conversion is the position of the leading one
+        lo = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(lo)), 23);
+        hi = _mm_srli_epi32(_mm_castps_si128(_mm_cvtepi32_ps(hi)), 23);
+        lo = _mm_max_epi32(_mm_sub_epi32(lo, bias), zero);
+        hi = _mm_max_epi32(_mm_sub_epi32(hi, bias), zero);
+        _mm_storel_epi64((__m128i*)(categories + i),
+                         _mm_packus_epi16(_mm_packus_epi32(lo, hi), zero));
+    }
+    return i;
+}
+#elif defined(__aarch64__)
+static uint32_t diffCategoriesSIMD(const int16_t* diffs, uint8_t* categories, uint32_t count) {
+    const uint16x8_t sixteen = vdupq_n_u16(16);
+    uint32_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t magnitude = vreinterpretq_u16_s16(vabsq_s16(vld1q_s16(diffs + i)));
+        vst1_u8(categories + i, vmovn_u16(vsubq_u16(sixteen, vclzq_u16(magnitude))));
+    }
+    return i;
+}
+#endif
+
+/*****************************************************************************/
+
 class dng_lossless_encoder {
    private:
     const uint16_t* fSrcData;
@@ -2173,6 +2282,11 @@ class dng_lossless_encoder {
     std::vector<uint8_t> streamBuffer;
     size_t streamBufferOffset;
 
+    // Predictor differences and their Huffman categories for the row being encoded
+
+    std::vector<int16_t> rowDiffs;
+    std::vector<uint8_t> rowCategories;
+
    public:
     dng_lossless_encoder(const uint16_t* srcData, uint32_t srcRows, uint32_t srcCols,
                          uint32_t srcChannels, uint32_t srcBitDepth, int32_t srcRowStep,
@@ -2193,12 +2307,10 @@ class dng_lossless_encoder {
 
     int EmitBitsToBuffer(int buffered_bits, uint64_t bit_buffer);
 
-    int EncodeOneDiffToBuffer(int diff, HuffmanTable* dctbl, int buffered_bits,
+    int EncodeOneDiffToBuffer(int diff, int nbits, HuffmanTable* dctbl, int buffered_bits,
                               uint64_t& bit_buffer);
 
-    void CountOneDiff(int diff, uint32_t* countTable);
-
-    void EncodeOneDiff(int diff, HuffmanTable* dctbl);
+    void ComputeRowDiffs(int32_t row);
 
     void FreqCountSet();
 
@@ -2285,6 +2397,9 @@ dng_lossless_encoder::dng_lossless_encoder(const uint16_t* srcData, uint32_t src
 
     streamBufferExtent = std::max<size_t>(streamBufferExtent, srcChannels * 296 + 64);
     streamBuffer.resize(streamBufferExtent);
+
+    rowDiffs.resize(srcCols * srcChannels);
+    rowCategories.resize(srcCols * srcChannels);
 }
 
 /*****************************************************************************/
@@ -2404,15 +2519,17 @@ void dng_lossless_encoder::FlushBuffer() {
 }
 
 /*****************************************************************************/
+
 /*
  *--------------------------------------------------------------
  *
- * CountOneDiff --
+ * ComputeRowDiffs --
  *
- *        Count the difference value in countTable.
+ *        Compute the predictor differences of a row and the
+ *        number of bits of their magnitudes.
  *
  * Results:
- *        diff is counted in countTable.
+ *        rowDiffs and rowCategories hold the row's values.
  *
  * Side effects:
  *        None.
@@ -2420,76 +2537,59 @@ void dng_lossless_encoder::FlushBuffer() {
  *--------------------------------------------------------------
  */
 
-inline void dng_lossless_encoder::CountOneDiff(int diff, uint32_t* countTable) {
-    // Encode the DC coefficient difference per section F.1.2.1
+void dng_lossless_encoder::ComputeRowDiffs(int32_t row) {
+    const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
 
-    int temp = diff;
+    const uint32_t channels = fSrcChannels;
+    const uint32_t count = fSrcCols * channels;
 
-    if (temp < 0) {
-        temp = -temp;
+    if (count == 0) {
+        return;
     }
 
-    // Find the number of bits needed for the magnitude of the coefficient
+    int16_t* diffs = rowDiffs.data();
+    uint8_t* categories = rowCategories.data();
 
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
+    // The first pixel of a row is predicted from the one above it, or from the
+    // middle of the value range for the first row.
 
-    // Update count for this bit length
-
-    countTable[nbits]++;
-}
+    for (int32_t channel = 0; channel < (int32_t)channels; channel++) {
+        int32_t predictor = row == 0 ? 1 << (fSrcBitDepth - 1) : sPtr[channel - fSrcRowStep];
 
-/*****************************************************************************/
-
-/*
- *--------------------------------------------------------------
- *
- * EncodeOneDiff --
- *
- *    Encode a single difference value.
- *
- * Results:
- *    None.
- *
- * Side effects:
- *    None.
- *
- *--------------------------------------------------------------
- */
-
-inline void dng_lossless_encoder::EncodeOneDiff(int diff, HuffmanTable* dctbl) {
-    // Encode the DC coefficient difference per section F.1.2.1
-
-    int temp = diff;
-    int temp2 = diff;
-
-    if (temp < 0) {
-        temp = -temp;
-
-        // For a negative input, want temp2 = bitwise complement of
-        // abs (input).     This code assumes we are on a two's complement
-        // machine.
-
-        temp2--;
+        diffs[channel] = (int16_t)(sPtr[channel] - predictor);
     }
 
-    // Find the number of bits needed for the magnitude of the coefficient
-
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
+    // All other pixels are predicted from the previous pixel of the same channel.
 
-    // Emit the Huffman-coded symbol for the number of bits
+    if (fSrcColStep == (int32_t)channels) {
+        uint32_t i = channels;
+#if GLS_SIMD_ENCODE
+        i = rowDifferencesSIMD(sPtr, diffs, i, count, channels);
+#endif
+        for (; i < count; i++) {
+            diffs[i] = (int16_t)(sPtr[i] - sPtr[i - channels]);
+        }
+    } else {
+        for (uint32_t col = 1; col < fSrcCols; col++) {
+            const uint16_t* pixel = sPtr + (int32_t)col * fSrcColStep;
 
-    EmitBits(dctbl->ehufco[nbits], dctbl->ehufsi[nbits]);
+            for (uint32_t channel = 0; channel < channels; channel++) {
+                diffs[col * channels + channel] =
+                    (int16_t)(pixel[channel] - pixel[(int32_t)channel - fSrcColStep]);
+            }
+        }
+    }
 
-    // Emit that number of bits of the value, if positive,
-    // or the complement of its magnitude, if negative.
+    // Find the number of bits needed for the magnitude of the differences
 
-    // If the number of bits is 16, there is only one possible difference
-    // value (-32786), so the lossless JPEG spec says not to output anything
-    // in that case.  So we only need to output the diference value if
-    // the number of bits is between 1 and 15.
+    uint32_t i = 0;
+#if GLS_SIMD_ENCODE
+    i = diffCategoriesSIMD(diffs, categories, count);
+#endif
+    for (; i < count; i++) {
+        int temp = diffs[i] < 0 ? -diffs[i] : diffs[i];
 
-    if (nbits & 15) {
-        EmitBits(temp2 & (0x0FFFF >> (16 - nbits)), nbits);
+        categories[i] = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
     }
 }
 
@@ -2510,32 +2610,36 @@ inline int dng_lossless_encoder::EmitBitsToBuffer(int buffered_bits, uint64_t bi
 
 /*****************************************************************************/
 
-inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, HuffmanTable* dctbl,
+inline int dng_lossless_encoder::EncodeOneDiffToBuffer(int diff, int nbits, HuffmanTable* dctbl,
                                                        int buffered_bits, uint64_t& bit_buffer) {
     DNG_ASSERT(buffered_bits < 64, "buffered_bits too big(1)");
 
     if (buffered_bits > 32) {
-        buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
+        // Fast path: emit four bytes at once unless one of them needs stuffing
+
+        uint32_t word = (uint32_t)(bit_buffer >> (buffered_bits - 32));
+        uint32_t inverted = ~word;
+
+        if (((inverted - 0x01010101) & ~inverted & 0x80808080) == 0) {
+            uint8_t* dst = &streamBuffer[streamBufferOffset];
+            dst[0] = (uint8_t)(word >> 24);
+            dst[1] = (uint8_t)(word >> 16);
+            dst[2] = (uint8_t)(word >> 8);
+            dst[3] = (uint8_t)word;
+            streamBufferOffset += 4;
+            buffered_bits -= 32;
+        } else {
+            buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
+        }
     }
 
     // Encode the DC coefficient difference per section F.1.2.1
 
-    int temp = diff;
-    int temp2 = diff;
-
-    if (temp < 0) {
-        temp = -temp;
-
-        // For a negative input, want temp2 = bitwise complement of
-        // abs (input).     This code assumes we are on a two's complement
-        // machine.
-
-        temp2--;
-    }
-
-    // Find the number of bits needed for the magnitude of the coefficient
+    // For a negative input, want temp2 = bitwise complement of
+    // abs (input).     This code assumes we are on a two's complement
+    // machine.
 
-    int nbits = temp >= 256 ? numBitsTable[temp >> 8] + 8 : numBitsTable[temp & 0xFF];
+    int temp2 = diff < 0 ? diff - 1 : diff;
 
     // Emit the Huffman-coded symbol for the number of bits
     int bits_bits = dctbl->ehufsi[nbits];
@@ -2587,42 +2691,18 @@ void dng_lossless_encoder::FreqCountSet() {
     DNG_ASSERT((int32_t)fSrcRows >= 0, "dng_lossless_encoder::FreqCountSet: fSrcRpws too large.");
 
     for (int32_t row = 0; row < (int32_t)fSrcRows; row++) {
-        const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
+        ComputeRowDiffs(row);
 
-        // Initialize predictors for this row.
-
-        int32_t predictor[4] = {0, 0, 0, 0};
-
-        for (int32_t channel = 0; channel < (int32_t)fSrcChannels; channel++) {
-            if (row == 0)
-                predictor[channel] = 1 << (fSrcBitDepth - 1);
-            else
-                predictor[channel] = sPtr[channel - fSrcRowStep];
-        }
+        const uint8_t* categories = rowCategories.data();
 
         // Unroll most common case of two channels
 
         if (fSrcChannels == 2) {
-            int32_t pred0 = predictor[0];
-            int32_t pred1 = predictor[1];
-
-            uint32_t srcCols = fSrcCols;
-            int32_t srcColStep = fSrcColStep;
-
-            for (uint32_t col = 0; col < srcCols; col++) {
-                int32_t pixel0 = sPtr[0];
-                int32_t pixel1 = sPtr[1];
-
-                int16_t diff0 = (int16_t)(pixel0 - pred0);
-                int16_t diff1 = (int16_t)(pixel1 - pred1);
-
-                CountOneDiff(diff0, freqCount[0]);
-                CountOneDiff(diff1, freqCount[1]);
-
-                pred0 = pixel0;
-                pred1 = pixel1;
+            for (uint32_t col = 0; col < fSrcCols; col++) {
+                freqCount[0][categories[0]]++;
+                freqCount[1][categories[1]]++;
 
-                sPtr += srcColStep;
+                categories += 2;
             }
         }
 
@@ -2631,16 +2711,10 @@ void dng_lossless_encoder::FreqCountSet() {
         else {
             for (uint32_t col = 0; col < fSrcCols; col++) {
                 for (uint32_t channel = 0; channel < fSrcChannels; channel++) {
-                    int32_t pixel = sPtr[channel];
-
-                    int16_t diff = (int16_t)(pixel - predictor[channel]);
-
-                    CountOneDiff(diff, freqCount[channel]);
-
-                    predictor[channel] = pixel;
+                    freqCount[channel][categories[channel]]++;
                 }
 
-                sPtr += fSrcColStep;
+                categories += fSrcChannels;
             }
         }
     }
@@ -2667,57 +2741,27 @@ void dng_lossless_encoder::FreqCountSet() {
 void dng_lossless_encoder::HuffEncode() {
     DNG_ASSERT((int32_t)fSrcRows >= 0, "dng_lossless_encoder::HuffEncode: fSrcRows too large.");
 
-    uint64_t bit_buffer = 0;
-    int buffered_bits = 0;
-
-    if (fSrcChannels == 2) {
-        bit_buffer = huffPutBuffer;
-        buffered_bits = (int)huffPutBits;
-    }
+    uint64_t bit_buffer = huffPutBuffer;
+    int buffered_bits = (int)huffPutBits;
 
     for (int32_t row = 0; row < (int32_t)fSrcRows; row++) {
-        const uint16_t* sPtr = fSrcData + row * fSrcRowStep;
-
-        // Initialize predictors for this row.
-
-        int32_t predictor[4] = {0, 0, 0, 0};
+        ComputeRowDiffs(row);
 
-        for (int32_t channel = 0; channel < (int32_t)fSrcChannels; channel++) {
-            if (row == 0)
-                predictor[channel] = 1 << (fSrcBitDepth - 1);
-            else
-                predictor[channel] = sPtr[channel - fSrcRowStep];
-        }
+        const int16_t* diffs = rowDiffs.data();
+        const uint8_t* categories = rowCategories.data();
 
         // Unroll most common case of two channels
 
         if (fSrcChannels == 2) {
-            int32_t pred0 = predictor[0];
-            int32_t pred1 = predictor[1];
-
-            uint32_t srcCols = fSrcCols;
-            int32_t srcColStep = fSrcColStep;
-
-            for (uint32_t col = 0; col < srcCols; col++) {
-                int32_t pixel0 = sPtr[0];
-                int32_t pixel1 = sPtr[1];
-
-                int16_t diff0 = (int16_t)(pixel0 - pred0);
-                int16_t diff1 = (int16_t)(pixel1 - pred1);
-
-                buffered_bits =
-                    EncodeOneDiffToBuffer(diff0, &huffTable[0], buffered_bits, bit_buffer);
-                buffered_bits =
-                    EncodeOneDiffToBuffer(diff1, &huffTable[1], buffered_bits, bit_buffer);
-
-                pred0 = pixel0;
-                pred1 = pixel1;
+            for (uint32_t col = 0; col < fSrcCols; col++) {
+                buffered_bits = EncodeOneDiffToBuffer(diffs[0], categories[0], &huffTable[0],
+                                                      buffered_bits, bit_buffer);
+                buffered_bits = EncodeOneDiffToBuffer(diffs[1], categories[1], &huffTable[1],
+                                                      buffered_bits, bit_buffer);
 
-                sPtr += srcColStep;
+                diffs += 2;
+                categories += 2;
             }
-
-            buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
-
         }
 
         // General case.
@@ -2725,26 +2769,23 @@ void dng_lossless_encoder::HuffEncode() {
         else {
             for (uint32_t col = 0; col < fSrcCols; col++) {
                 for (uint32_t channel = 0; channel < fSrcChannels; channel++) {
-                    int32_t pixel = sPtr[channel];
-
-                    int16_t diff = (int16_t)(pixel - predictor[channel]);
-
-                    EncodeOneDiff(diff, &huffTable[channel]);
-
-                    predictor[channel] = pixel;
+                    buffered_bits =
+                        EncodeOneDiffToBuffer(diffs[channel], categories[channel],
+                                              &huffTable[channel], buffered_bits, bit_buffer);
                 }
 
-                sPtr += fSrcColStep;
+                diffs += fSrcChannels;
+                categories += fSrcChannels;
             }
         }
 
+        buffered_bits = EmitBitsToBuffer(buffered_bits, bit_buffer);
+
         FlushBuffer();
     }
 
-    if (fSrcChannels == 2) {
-        huffPutBuffer = bit_buffer;
-        huffPutBits = buffered_bits;
-    }
+    huffPutBuffer = bit_buffer;
+    huffPutBits = buffered_bits;
 
     FlushBits();
 }
@@ -25,11 +25,14 @@
 #include <string>
 #include <vector>
 
+#include "gls_image_glsraw.h"
 #include "gls_image_jpeg.h"
 #include "gls_image_png.h"
 #include "gls_image_tiff.h"
 
+#ifndef USE_FP16_FLOATS
 #define USE_FP16_FLOATS 1
+#endif
 
 namespace gls {
 
@@ -323,20 +326,28 @@ class image : public basic_image<T> {
 
     // Write image to PNG file
     // compression_level range: [0-9], 0 -> no compression (default), 1 -> *fast* compression, otherwise useful range: [3-6]
-    void write_png_file(const std::string& filename, int compression_level = 0) const {
+    // threads: number of concurrent compression chunks for large images, 0 -> all available cores
+    void write_png_file(const std::string& filename, int compression_level = 0, int threads = 1) const {
         auto row_pointer = [this](int row) -> uint8_t* { return (uint8_t*)(*this)[row]; };
         gls::write_png_file(filename, basic_image<T>::width, basic_image<T>::height, T::channels, T::bit_depth,
-                            false, compression_level, row_pointer);
+                            false, compression_level, row_pointer, threads);
     }
 
-    void write_png_file(const std::string& filename, bool skip_alpha, int compression_level = 0) const {
+    void write_png_file(const std::string& filename, bool skip_alpha, int compression_level = 0,
+                        int threads = 1) const {
         auto row_pointer = [this](int row) -> uint8_t* { return (uint8_t*)(*this)[row]; };
         gls::write_png_file(filename, basic_image<T>::width, basic_image<T>::height, T::channels, T::bit_depth,
-                            skip_alpha, compression_level, row_pointer);
+                            skip_alpha, compression_level, row_pointer, threads);
     }
 
     // Image factory from JPEG file
     static unique_ptr read_jpeg_file(const std::string& filename) {
+        return read_jpeg_file(filename, size(0, 0));
+    }
+
+    // Image factory from JPEG file, downscaled in the DCT domain: the resulting image is the smallest
+    // 1/8 multiple of the original size that is at least as large as target_size
+    static unique_ptr read_jpeg_file(const std::string& filename, size target_size) {
         unique_ptr image = nullptr;
 
         auto image_allocator = [&image](int width, int height) -> std::span<uint8_t> {
@@ -346,18 +357,20 @@ class image : public basic_image<T> {
             return std::span<uint8_t>((uint8_t*)(*image)[0], sizeof(T) * width * height);
         };
 
-        gls::read_jpeg_file(filename, T::channels, T::bit_depth, image_allocator);
+        gls::read_jpeg_file(filename, T::channels, T::bit_depth, image_allocator, target_size.width,
+                            target_size.height);
 
         return image;
     }
 
     // Write image to JPEG file
-    void write_jpeg_file(const std::string& filename, int quality) const {
+    // threads: number of concurrent encoding slices for large images (with restart markers), 0 -> all available cores
+    void write_jpeg_file(const std::string& filename, int quality, int threads = 1) const {
         auto image_data = [this]() -> std::span<uint8_t> {
             return std::span<uint8_t>((uint8_t*)this->_data.data(), sizeof(T) * this->_data.size());
         };
         gls::write_jpeg_file(filename, basic_image<T>::width, basic_image<T>::height, stride, T::channels, T::bit_depth,
-                             image_data, quality);
+                             image_data, quality, threads);
     }
 
     // Helper function for read_tiff_file and read_dng_file
@@ -425,9 +438,18 @@ class image : public basic_image<T> {
                                        compression, metadata, row_pointer);
     }
 
-    // Image factory from DNG file
-    static unique_ptr read_dng_file(const std::string& filename, tiff_metadata* dng_metadata = nullptr, tiff_metadata* exif_metadata = nullptr) {
+    // Image factory from DNG file. If roi is given only that region is decoded, on return it holds the region
+    // actually decoded, which includes a margin for demosaicing and has its origin aligned to the CFA pattern
+    static unique_ptr read_dng_file(const std::string& filename, tiff_metadata* dng_metadata = nullptr, tiff_metadata* exif_metadata = nullptr,
+                                    rectangle* roi = nullptr) {
         unique_ptr image = nullptr;
+        int roi_rect[4] = { 0, 0, 0, 0 };
+        if (roi) {
+            roi_rect[0] = roi->x;
+            roi_rect[1] = roi->y;
+            roi_rect[2] = roi->width;
+            roi_rect[3] = roi->height;
+        }
         gls::read_dng_file(filename, T::channels, T::bit_depth, dng_metadata, exif_metadata,
                             [&image](int width, int height) -> bool {
                                 return (image = std::make_unique<gls::image<T>>(width, height)) != nullptr;
@@ -438,17 +460,42 @@ class image : public basic_image<T> {
                                 return process_tiff_strip(image.get(), tiff_bitspersample, tiff_samplesperpixel,
                                                           row, /*strip_width=*/ strip_width, strip_height,
                                                           /*crop_x=*/ crop_x, /*crop_y=*/ crop_y, tiff_buffer);
-                            });
+                            }, roi_rect);
+        if (roi) {
+            *roi = rectangle(roi_rect[0], roi_rect[1], roi_rect[2], roi_rect[3]);
+        }
         return image;
     }
 
-    // Write image to DNG file
+    // Image factory from a glsraw raw cache file
+    static unique_ptr read_glsraw_file(const std::string& filename, tiff_metadata* dng_metadata = nullptr,
+                                       tiff_metadata* exif_metadata = nullptr, int threads = 0) {
+        static_assert(T::channels == 1 && T::bit_depth == 16, "glsraw files hold 16 bit raw images");
+        unique_ptr image = nullptr;
+        gls::read_glsraw_file(filename, dng_metadata, exif_metadata,
+                              [&image](int width, int height) -> bool {
+                                  return (image = std::make_unique<gls::image<T>>(width, height)) != nullptr;
+                              },
+                              [&image](int row) -> uint16_t* { return (uint16_t*)(*image)[row]; }, threads);
+        return image;
+    }
+
+    // Write image to a glsraw raw cache file
+    void write_glsraw_file(const std::string& filename, const tiff_metadata* dng_metadata = nullptr,
+                           const tiff_metadata* exif_metadata = nullptr, int threads = 0) const {
+        static_assert(T::channels == 1 && T::bit_depth == 16, "glsraw files hold 16 bit raw images");
+        gls::write_glsraw_file(filename, basic_image<T>::width, basic_image<T>::height, dng_metadata, exif_metadata,
+                               [this](int row) -> const uint16_t* { return (const uint16_t*)(*this)[row]; }, threads);
+    }
+
+    // Write image to DNG file, bit_depth is the sensor's bit depth (derived from the white level if 0)
     void write_dng_file(const std::string& filename, tiff_compression compression = tiff_compression::NONE,
-                        const tiff_metadata* dng_metadata = nullptr, const tiff_metadata* exif_metadata = nullptr) const {
+                        const tiff_metadata* dng_metadata = nullptr, const tiff_metadata* exif_metadata = nullptr,
+                        int bit_depth = 0) const {
         typedef typename T::dataType dataType;
         auto row_pointer = [this](int row) -> dataType* { return (dataType*)(*this)[row]; };
         gls::write_dng_file(filename, basic_image<T>::width, basic_image<T>::height, T::channels, T::bit_depth,
-                            compression, dng_metadata, exif_metadata, row_pointer);
+                            compression, dng_metadata, exif_metadata, row_pointer, bit_depth);
     }
 };
 
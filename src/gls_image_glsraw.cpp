@@ -0,0 +1,386 @@
+// Copyright (c) 2021-2022 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gls_image_glsraw.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "gls_mapped_file.hpp"
+#include "gls_parallel.hpp"
+
+namespace gls {
+
+// File layout, all values little endian:
+//
+//   glsraw_header
+//   uint64_t band_offsets[band_count + 1]   start of each band and end of the last one
+//   bands, each starting at a 16 byte boundary
+//   serialized DNG metadata, serialized EXIF metadata
+//
+// A band holds band_rows image rows (fewer for the last band). Samples are predicted from the sample two rows up,
+// so that the prediction uses the same CFA color and is independent across each row. The first two rows of a band
+// are predicted from the sample two columns to the left instead, which keeps bands independent of each other.
+// Residuals are zigzag mapped to unsigned values and packed in groups of 128 samples at the bit width of the largest
+// value in the group. A band starts with the bit widths of its groups (one byte each, padded to 16 bytes) followed
+// by the packed groups. A group packed at b bits takes b 16 byte words: sample i of the group is in 16 bit lane
+// i % 8, lanes are filled LSB first, so that 8 samples are extracted at once with uniform vector shifts.
+
+static const char kGlsRawMagic[8] = { 'G', 'L', 'S', 'R', 'A', 'W', 0, 0 };
+static const uint32_t kGlsRawVersion = 1;
+static const int kBandRows = 16;
+static const int kGroupSize = 128;
+static const int kGroupLanes = 8;
+
+struct glsraw_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t band_rows;
+    uint32_t band_count;
+    uint32_t reserved;
+    uint64_t dng_metadata_offset;
+    uint64_t dng_metadata_size;
+    uint64_t exif_metadata_offset;
+    uint64_t exif_metadata_size;
+};
+
+static inline size_t align16(size_t size) { return (size + 15) & ~(size_t) 15; }
+
+static inline uint16_t zigzag(int difference) {
+    const int16_t d = (int16_t) difference;
+    return (uint16_t) ((d << 1) ^ (d >> 15));
+}
+
+static inline uint16_t unzigzag(uint16_t z) { return (uint16_t) ((z >> 1) ^ -(z & 1)); }
+
+static void packGroup(const uint16_t* in, int bits, uint8_t* out) {
+    uint16_t* words = (uint16_t*) out;
+    for (int lane = 0; lane < kGroupLanes; lane++) {
+        uint32_t accumulator = 0;
+        int available_bits = 0;
+        int word = 0;
+        for (int k = 0; k < kGroupSize / kGroupLanes; k++) {
+            accumulator |= (uint32_t) in[kGroupLanes * k + lane] << available_bits;
+            available_bits += bits;
+            if (available_bits >= 16) {
+                words[kGroupLanes * word++ + lane] = (uint16_t) accumulator;
+                accumulator >>= 16;
+                available_bits -= 16;
+            }
+        }
+    }
+}
+
+// Unpacks the 128 values of a group, 8 lanes at a time. Each iteration shifts the current word of every lane down
+// to the next value, completing values which straddle two words with the low bits of the next word.
+
+#if defined(__SSE2__)
+static void unpackGroup(const uint8_t* in, int bits, uint16_t* out) {
+    const __m128i* words = (const __m128i*) in;
+    const __m128i mask = _mm_set1_epi16((int16_t) ((1 << bits) - 1));
+    __m128i current = bits > 0 ? _mm_loadu_si128(words) : _mm_setzero_si128();
+    int shift = 0;
+    for (int k = 0; k < kGroupSize / kGroupLanes; k++) {
+        __m128i value = _mm_srl_epi16(current, _mm_cvtsi32_si128(shift));
+        shift += bits;
+        if (shift > 16) {
+            current = _mm_loadu_si128(++words);
+            shift -= 16;
+            value = _mm_or_si128(value, _mm_sll_epi16(current, _mm_cvtsi32_si128(bits - shift)));
+        } else if (shift == 16 && k < kGroupSize / kGroupLanes - 1) {
+            current = _mm_loadu_si128(++words);
+            shift = 0;
+        }
+        _mm_storeu_si128((__m128i*) (out + kGroupLanes * k), _mm_and_si128(value, mask));
+    }
+}
+#elif defined(__aarch64__)
+static void unpackGroup(const uint8_t* in, int bits, uint16_t* out) {
+    const uint16_t* words = (const uint16_t*) in;
+    const uint16x8_t mask = vdupq_n_u16((uint16_t) ((1 << bits) - 1));
+    uint16x8_t current = bits > 0 ? vld1q_u16(words) : vdupq_n_u16(0);
+    int shift = 0;
+    for (int k = 0; k < kGroupSize / kGroupLanes; k++) {
+        uint16x8_t value = vshlq_u16(current, vdupq_n_s16(-shift));
+        shift += bits;
+        if (shift > 16) {
+            words += kGroupLanes;
+            current = vld1q_u16(words);
+            shift -= 16;
+            value = vorrq_u16(value, vshlq_u16(current, vdupq_n_s16(bits - shift)));
+        } else if (shift == 16 && k < kGroupSize / kGroupLanes - 1) {
+            words += kGroupLanes;
+            current = vld1q_u16(words);
+            shift = 0;
+        }
+        vst1q_u16(out + kGroupLanes * k, vandq_u16(value, mask));
+    }
+}
+#else
+static void unpackGroup(const uint8_t* in, int bits, uint16_t* out) {
+    const uint16_t* words = (const uint16_t*) in;
+    const uint16_t mask = (uint16_t) ((1 << bits) - 1);
+    for (int lane = 0; lane < kGroupLanes; lane++) {
+        uint32_t accumulator = 0;
+        int available_bits = 0;
+        int word = 0;
+        for (int k = 0; k < kGroupSize / kGroupLanes; k++) {
+            if (available_bits < bits) {
+                accumulator |= (uint32_t) words[kGroupLanes * word++ + lane] << available_bits;
+                available_bits += 16;
+            }
+            out[kGroupLanes * k + lane] = accumulator & mask;
+            accumulator >>= bits;
+            available_bits -= bits;
+        }
+    }
+}
+#endif
+
+// Adds the residuals to the row two rows up, returns the number of samples processed
+
+#if defined(__SSE2__)
+static int predictFromAboveSIMD(uint16_t* row, const uint16_t* above, const uint16_t* residuals, int width) {
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i z = _mm_loadu_si128((const __m128i*) (residuals + x));
+        __m128i difference = _mm_xor_si128(_mm_srli_epi16(z, 1), _mm_sub_epi16(zero, _mm_and_si128(z, one)));
+        _mm_storeu_si128((__m128i*) (row + x),
+                         _mm_add_epi16(_mm_loadu_si128((const __m128i*) (above + x)), difference));
+    }
+    return x;
+}
+#elif defined(__aarch64__)
+static int predictFromAboveSIMD(uint16_t* row, const uint16_t* above, const uint16_t* residuals, int width) {
+    const uint16x8_t one = vdupq_n_u16(1);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint16x8_t z = vld1q_u16(residuals + x);
+        uint16x8_t sign = vreinterpretq_u16_s16(vnegq_s16(vreinterpretq_s16_u16(vandq_u16(z, one))));
+        vst1q_u16(row + x, vaddq_u16(vld1q_u16(above + x), veorq_u16(vshrq_n_u16(z, 1), sign)));
+    }
+    return x;
+}
+#else
+static int predictFromAboveSIMD(uint16_t*, const uint16_t*, const uint16_t*, int) { return 0; }
+#endif
+
+static std::vector<uint8_t> encodeBand(int width, int first_row, int rows,
+                                       const std::function<const uint16_t*(int row)>& row_pointer) {
+    const size_t samples = (size_t) width * rows;
+    const size_t groups = (samples + kGroupSize - 1) / kGroupSize;
+
+    std::vector<uint16_t> residuals(groups * kGroupSize, 0);
+    for (int r = 0; r < rows; r++) {
+        const uint16_t* row = row_pointer(first_row + r);
+        uint16_t* residual = residuals.data() + (size_t) r * width;
+        if (r >= 2) {
+            const uint16_t* above = row_pointer(first_row + r - 2);
+            for (int x = 0; x < width; x++) {
+                residual[x] = zigzag(row[x] - above[x]);
+            }
+        } else {
+            for (int x = 0; x < width; x++) {
+                residual[x] = zigzag(row[x] - (x >= 2 ? row[x - 2] : 0));
+            }
+        }
+    }
+
+    std::vector<uint8_t> band(align16(groups), 0);
+    for (size_t g = 0; g < groups; g++) {
+        const uint16_t* group = residuals.data() + g * kGroupSize;
+        uint16_t values = 0;
+        for (int i = 0; i < kGroupSize; i++) {
+            values |= group[i];
+        }
+        const int bits = std::bit_width(values);
+        band[g] = (uint8_t) bits;
+
+        const size_t offset = band.size();
+        band.resize(offset + bits * kGroupSize / 8);
+        packGroup(group, bits, band.data() + offset);
+    }
+    return band;
+}
+
+static void decodeBand(const uint8_t* band, size_t band_size, int width, int first_row, int rows,
+                       const std::function<uint16_t*(int row)>& row_pointer, std::vector<uint16_t>* residuals) {
+    const size_t samples = (size_t) width * rows;
+    const size_t groups = (samples + kGroupSize - 1) / kGroupSize;
+
+    if (align16(groups) > band_size) {
+        throw std::runtime_error("Corrupted glsraw band data.");
+    }
+
+    residuals->resize(groups * kGroupSize);
+    const uint8_t* group = band + align16(groups);
+    for (size_t g = 0; g < groups; g++) {
+        const int bits = band[g];
+        if (bits > 16 || group + bits * kGroupSize / 8 > band + band_size) {
+            throw std::runtime_error("Corrupted glsraw band data.");
+        }
+        unpackGroup(group, bits, residuals->data() + g * kGroupSize);
+        group += bits * kGroupSize / 8;
+    }
+
+    for (int r = 0; r < rows; r++) {
+        uint16_t* row = row_pointer(first_row + r);
+        const uint16_t* residual = residuals->data() + (size_t) r * width;
+        if (r >= 2) {
+            const uint16_t* above = row_pointer(first_row + r - 2);
+            for (int x = predictFromAboveSIMD(row, above, residual, width); x < width; x++) {
+                row[x] = above[x] + unzigzag(residual[x]);
+            }
+        } else {
+            for (int x = 0; x < width; x++) {
+                row[x] = (x >= 2 ? row[x - 2] : 0) + unzigzag(residual[x]);
+            }
+        }
+    }
+}
+
+std::vector<uint8_t> encode_glsraw(int width, int height, const tiff_metadata* dng_metadata,
+                                   const tiff_metadata* exif_metadata,
+                                   std::function<const uint16_t*(int row)> row_pointer, int threads) {
+    const int band_count = (height + kBandRows - 1) / kBandRows;
+
+    std::vector<std::vector<uint8_t>> bands(band_count);
+    parallel_for(band_count, parallel_threads(threads), [&](int band) {
+        const int first_row = band * kBandRows;
+        bands[band] = encodeBand(width, first_row, std::min(kBandRows, height - first_row), row_pointer);
+    });
+
+    const auto dng_data = dng_metadata ? dng_metadata->serialize() : std::vector<uint8_t>();
+    const auto exif_data = exif_metadata ? exif_metadata->serialize() : std::vector<uint8_t>();
+
+    std::vector<uint64_t> band_offsets(band_count + 1);
+    size_t offset = align16(sizeof(glsraw_header) + band_offsets.size() * sizeof(uint64_t));
+    for (int band = 0; band < band_count; band++) {
+        band_offsets[band] = offset;
+        offset = align16(offset + bands[band].size());
+    }
+    band_offsets[band_count] = offset;
+
+    glsraw_header header = {
+        .version = kGlsRawVersion,
+        .width = (uint32_t) width,
+        .height = (uint32_t) height,
+        .band_rows = kBandRows,
+        .band_count = (uint32_t) band_count,
+        .reserved = 0,
+        .dng_metadata_offset = offset,
+        .dng_metadata_size = dng_data.size(),
+        .exif_metadata_offset = offset + dng_data.size(),
+        .exif_metadata_size = exif_data.size(),
+    };
+    memcpy(header.magic, kGlsRawMagic, sizeof(header.magic));
+
+    std::vector<uint8_t> data(offset + dng_data.size() + exif_data.size(), 0);
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), band_offsets.data(), band_offsets.size() * sizeof(uint64_t));
+    for (int band = 0; band < band_count; band++) {
+        std::copy(bands[band].begin(), bands[band].end(), data.begin() + band_offsets[band]);
+    }
+    std::copy(dng_data.begin(), dng_data.end(), data.begin() + header.dng_metadata_offset);
+    std::copy(exif_data.begin(), exif_data.end(), data.begin() + header.exif_metadata_offset);
+    return data;
+}
+
+void decode_glsraw(const uint8_t* data, size_t size, tiff_metadata* dng_metadata, tiff_metadata* exif_metadata,
+                   std::function<bool(int width, int height)> image_allocator,
+                   std::function<uint16_t*(int row)> row_pointer, int threads) {
+    glsraw_header header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("Truncated glsraw data.");
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, kGlsRawMagic, sizeof(header.magic)) != 0 || header.version != kGlsRawVersion) {
+        throw std::runtime_error("Not a glsraw file, or unsupported version.");
+    }
+    const int band_count = (int) header.band_count;
+    if (header.band_rows < 2 || header.band_count != (header.height + header.band_rows - 1) / header.band_rows ||
+        sizeof(header) + (band_count + 1) * sizeof(uint64_t) > size ||
+        header.dng_metadata_offset + header.dng_metadata_size > size ||
+        header.exif_metadata_offset + header.exif_metadata_size > size) {
+        throw std::runtime_error("Corrupted glsraw header.");
+    }
+
+    std::vector<uint64_t> band_offsets(band_count + 1);
+    memcpy(band_offsets.data(), data + sizeof(header), band_offsets.size() * sizeof(uint64_t));
+    for (int band = 0; band < band_count; band++) {
+        if (band_offsets[band] > band_offsets[band + 1] || band_offsets[band + 1] > size) {
+            throw std::runtime_error("Corrupted glsraw band table.");
+        }
+    }
+
+    if (dng_metadata) {
+        dng_metadata->deserialize(data + header.dng_metadata_offset, header.dng_metadata_size);
+    }
+    if (exif_metadata) {
+        exif_metadata->deserialize(data + header.exif_metadata_offset, header.exif_metadata_size);
+    }
+
+    const int width = (int) header.width;
+    const int height = (int) header.height;
+    if (!image_allocator(width, height)) {
+        throw std::runtime_error("Couldn't allocate image storage");
+    }
+
+    parallel_for(band_count, parallel_threads(threads), [&](int band) {
+        thread_local std::vector<uint16_t> residuals;
+        const int first_row = band * (int) header.band_rows;
+        decodeBand(data + band_offsets[band], band_offsets[band + 1] - band_offsets[band], width, first_row,
+                   std::min((int) header.band_rows, height - first_row), row_pointer, &residuals);
+    });
+}
+
+void write_glsraw_file(const std::string& filename, int width, int height, const tiff_metadata* dng_metadata,
+                       const tiff_metadata* exif_metadata, std::function<const uint16_t*(int row)> row_pointer,
+                       int threads) {
+    const auto data = encode_glsraw(width, height, dng_metadata, exif_metadata, row_pointer, threads);
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Couldn't open glsraw file for writing.");
+    }
+    const bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (fclose(file) != 0 || !written) {
+        throw std::runtime_error("Failed to write glsraw file.");
+    }
+}
+
+void read_glsraw_file(const std::string& filename, tiff_metadata* dng_metadata, tiff_metadata* exif_metadata,
+                      std::function<bool(int width, int height)> image_allocator,
+                      std::function<uint16_t*(int row)> row_pointer, int threads) {
+    mapped_file file(filename.c_str());
+    if (!file.data) {
+        throw std::runtime_error("Couldn't read glsraw file.");
+    }
+    decode_glsraw(file.data, file.size, dng_metadata, exif_metadata, image_allocator, row_pointer, threads);
+}
+
+}  // namespace gls
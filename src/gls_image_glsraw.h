@@ -0,0 +1,53 @@
+// Copyright (c) 2021-2022 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef GLS_IMAGE_GLSRAW_H
+#define GLS_IMAGE_GLSRAW_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "gls_tiff_metadata.hpp"
+
+namespace gls {
+
+// .glsraw is a lossless cache container for 16 bit raw images and their DNG and EXIF metadata, meant for
+// re-processing the same raw files many times. The image is split in independent bands of rows which are delta
+// coded and bit packed in groups of 128 samples, so that bands decode in parallel and groups unpack with a few
+// vector instructions. The file can be decoded straight from a memory mapping.
+//
+// threads: number of concurrent encoding/decoding workers, 0 -> all available cores
+
+std::vector<uint8_t> encode_glsraw(int width, int height, const tiff_metadata* dng_metadata,
+                                   const tiff_metadata* exif_metadata,
+                                   std::function<const uint16_t*(int row)> row_pointer, int threads = 0);
+
+void decode_glsraw(const uint8_t* data, size_t size, tiff_metadata* dng_metadata, tiff_metadata* exif_metadata,
+                   std::function<bool(int width, int height)> image_allocator,
+                   std::function<uint16_t*(int row)> row_pointer, int threads = 0);
+
+void write_glsraw_file(const std::string& filename, int width, int height, const tiff_metadata* dng_metadata,
+                       const tiff_metadata* exif_metadata, std::function<const uint16_t*(int row)> row_pointer,
+                       int threads = 0);
+
+void read_glsraw_file(const std::string& filename, tiff_metadata* dng_metadata, tiff_metadata* exif_metadata,
+                      std::function<bool(int width, int height)> image_allocator,
+                      std::function<uint16_t*(int row)> row_pointer, int threads = 0);
+
+}  // namespace gls
+
+#endif /* GLS_IMAGE_GLSRAW_H */
@@ -17,12 +17,32 @@
 
 #include <jpeglib.h>
 
+#include <algorithm>
 #include <cassert>
+#include <future>
+#include <thread>
+#include <vector>
 
 namespace gls {
 
+// Find the largest IDCT downscaling (scale_num / 8) that produces an image of at least target_width x target_height
+static void setScaleFactorForTargetSize(::jpeg_decompress_struct* decompressInfo, int target_width, int target_height) {
+    const int scale_denom = 8;
+    for (int scale_num = 1; scale_num < scale_denom; scale_num++) {
+        // libjpeg rounds up the scaled output dimensions
+        const int scaled_width = (decompressInfo->image_width * scale_num + scale_denom - 1) / scale_denom;
+        const int scaled_height = (decompressInfo->image_height * scale_num + scale_denom - 1) / scale_denom;
+        if (scaled_width >= target_width && scaled_height >= target_height) {
+            decompressInfo->scale_num = scale_num;
+            decompressInfo->scale_denom = scale_denom;
+            return;
+        }
+    }
+}
+
 void read_jpeg_file(const std::string& filename, int pixel_channels, int pixel_bit_depth,
-                    std::function<std::span<uint8_t>(int width, int height)> image_allocator) {
+                    std::function<std::span<uint8_t>(int width, int height)> image_allocator,
+                    int target_width, int target_height) {
     if ((pixel_channels != 3 && pixel_channels != 1) || pixel_bit_depth != 8) {
         throw std::runtime_error("Can only create JPEG files for 8-bit RGB or Grayscale images");
     }
@@ -66,6 +86,11 @@ void read_jpeg_file(const std::string& filename, int pixel_channels, int pixel_b
     if (rc != 1) {
         throw std::runtime_error("File does not seem to be a normal JPEG");
     }
+
+    if (target_width > 0 && target_height > 0) {
+        setScaleFactorForTargetSize(decompressInfo.get(), target_width, target_height);
+    }
+
     ::jpeg_start_decompress(decompressInfo.get());
 
     int width = decompressInfo->output_width;
@@ -97,10 +122,148 @@ void read_jpeg_file(const std::string& filename, int pixel_channels, int pixel_b
     ::jpeg_finish_decompress(decompressInfo.get());
 }
 
+// Throw instead of the default libjpeg error handler, which prints the error message and calls exit()
+static void throwJpegError(::j_common_ptr cinfo) {
+    char jpegLastErrorMsg[JMSG_LENGTH_MAX];
+    (*(cinfo->err->format_message))(cinfo, jpegLastErrorMsg);
+    throw std::runtime_error(jpegLastErrorMsg);
+}
+
+static void writeJpegData(FILE* outfile, const void* data, size_t size) {
+    if (fwrite(data, 1, size, outfile) != size) {
+        throw std::runtime_error("Failed to write JPEG data");
+    }
+}
+
+// Parallel encoding splits the image in horizontal slices of kSliceMCURows MCU rows, each slice is
+// encoded independently with a restart marker at every MCU row. Using a multiple of 8 MCU rows
+// keeps the restart marker sequence (RST0..RST7) continuous when the slices are concatenated.
+static const int kSliceMCURows = 8;
+
+struct jpeg_memory_buffer {
+    unsigned char* data = nullptr;
+    unsigned long size = 0;
+
+    ~jpeg_memory_buffer() { free(data); }
+};
+
+static void compressJpegImage(::jpeg_compress_struct* compressInfo, int width, int height, int pixel_channels,
+                              int quality, int restart_in_rows, uint8_t* data, size_t row_stride) {
+    compressInfo->image_width = (JDIMENSION)width;
+    compressInfo->image_height = (JDIMENSION)height;
+    compressInfo->input_components = (JDIMENSION)pixel_channels;
+    compressInfo->in_color_space = static_cast<::J_COLOR_SPACE>(pixel_channels == 3 ? ::JCS_RGB : ::JCS_GRAYSCALE);
+#ifdef JCS_EXTENSIONS
+    if (pixel_channels == 4) {
+        // libjpeg-turbo reads RGBA pixels in place, ignoring the alpha channel
+        compressInfo->in_color_space = ::JCS_EXT_RGBX;
+    }
+#endif
+    ::jpeg_set_defaults(compressInfo);
+    ::jpeg_set_quality(compressInfo, quality, TRUE);
+    compressInfo->restart_in_rows = restart_in_rows;
+    ::jpeg_start_compress(compressInfo, TRUE);
+
+    uint8_t* ptr = data;
+    for (int line = 0; line < height; line++) {
+        ::jpeg_write_scanlines(compressInfo, &ptr, 1);
+        ptr += row_stride;
+    }
+
+    ::jpeg_finish_compress(compressInfo);
+}
+
+// Encode a horizontal slice of the image into a memory buffer, with a restart marker at every MCU row
+static void compressJpegSlice(int width, int height, int pixel_channels, int quality, uint8_t* data,
+                              size_t row_stride, jpeg_memory_buffer* buffer) {
+    auto errorMgr = std::make_shared<::jpeg_error_mgr>();
+
+    auto dt = [](::jpeg_compress_struct* cs) { ::jpeg_destroy_compress(cs); };
+    std::unique_ptr<::jpeg_compress_struct, decltype(dt)> compressInfo(new ::jpeg_compress_struct, dt);
+    compressInfo->err = ::jpeg_std_error(errorMgr.get());
+    // The exception is propagated by the slice's future
+    errorMgr->error_exit = throwJpegError;
+    ::jpeg_create_compress(compressInfo.get());
+    ::jpeg_mem_dest(compressInfo.get(), &buffer->data, &buffer->size);
+
+    compressJpegImage(compressInfo.get(), width, height, pixel_channels, quality, /*restart_in_rows=*/1, data,
+                      row_stride);
+}
+
+// Find the Start Of Scan segment, returns the offset of the entropy coded data following it.
+// Also returns the offset of the Start Of Frame segment, to be able to patch the image height.
+static size_t findJpegScanData(const jpeg_memory_buffer& buffer, size_t* sof_offset) {
+    size_t offset = 2;  // Skip SOI
+    while (offset + 4 <= buffer.size) {
+        if (buffer.data[offset] != 0xFF) {
+            throw std::runtime_error("Malformed JPEG slice");
+        }
+        const uint8_t marker = buffer.data[offset + 1];
+        const size_t length = (buffer.data[offset + 2] << 8) | buffer.data[offset + 3];
+        if (marker == 0xC0 && sof_offset) {  // SOF0
+            *sof_offset = offset;
+        }
+        offset += 2 + length;
+        if (marker == 0xDA) {  // SOS
+            return offset;
+        }
+    }
+    throw std::runtime_error("Malformed JPEG slice");
+}
+
+static void write_jpeg_file_parallel(FILE* outfile, int width, int height, int pixel_channels, int quality,
+                                     uint8_t* data, size_t row_stride, int slices, int slice_height) {
+    std::vector<jpeg_memory_buffer> buffers(slices);
+    std::vector<std::future<void>> encoders;
+    for (int i = 0; i < slices; i++) {
+        const int y = i * slice_height;
+        const int h = std::min(slice_height, height - y);
+        encoders.push_back(std::async(std::launch::async, compressJpegSlice, width, h, pixel_channels, quality,
+                                      data + y * row_stride, row_stride, &buffers[i]));
+    }
+    // Wait for all slices before rethrowing any error, the encoders reference the buffers
+    for (auto& encoder : encoders) {
+        encoder.wait();
+    }
+    for (auto& encoder : encoders) {
+        encoder.get();
+    }
+
+    // Stitch the slices together: headers from the first slice (with the full image height),
+    // followed by the entropy coded segments of all the slices separated by restart markers.
+    size_t sof_offset = 0;
+    const size_t scan_offset = findJpegScanData(buffers[0], &sof_offset);
+    buffers[0].data[sof_offset + 5] = (uint8_t)(height >> 8);
+    buffers[0].data[sof_offset + 6] = (uint8_t)(height & 0xFF);
+    writeJpegData(outfile, buffers[0].data, scan_offset);
+
+    for (int i = 0; i < slices; i++) {
+        const size_t offset = i == 0 ? scan_offset : findJpegScanData(buffers[i], nullptr);
+        if (i > 0) {
+            // Every slice is a multiple of 8 MCU rows, the previous restart marker is always RST7
+            const uint8_t restart_marker[2] = {0xFF, 0xD7};
+            writeJpegData(outfile, restart_marker, sizeof(restart_marker));
+        }
+        // Skip the slice's EOI marker
+        writeJpegData(outfile, buffers[i].data + offset, buffers[i].size - offset - 2);
+    }
+    const uint8_t end_of_image[2] = {0xFF, 0xD9};
+    writeJpegData(outfile, end_of_image, sizeof(end_of_image));
+    if (fflush(outfile) != 0) {
+        throw std::runtime_error("Failed to write JPEG data");
+    }
+}
+
 void write_jpeg_file(const std::string& fileName, int width, int height, int stride, int pixel_channels,
-                     int pixel_bit_depth, const std::function<std::span<uint8_t>()>& image_data, int quality) {
-    if ((pixel_channels != 3 && pixel_channels != 1) || pixel_bit_depth != 8) {
-        throw std::runtime_error("Can only create JPEG files for 8-bit RGB or Grayscale images");
+                     int pixel_bit_depth, const std::function<std::span<uint8_t>()>& image_data, int quality,
+                     int threads) {
+#ifdef JCS_EXTENSIONS
+    const bool rgbx_input = pixel_channels == 4;
+#else
+    const bool rgbx_input = false;
+#endif
+    if ((pixel_channels != 3 && pixel_channels != 1 && !rgbx_input) || pixel_bit_depth != 8) {
+        throw std::runtime_error("Can only create JPEG files for 8-bit RGB, RGBA or Grayscale images");
     }
 
     if (quality < 0) {
@@ -109,11 +272,33 @@ void write_jpeg_file(const std::string& fileName, int width, int height, int str
     if (quality > 100) {
         quality = 100;
     }
-    FILE* outfile = fopen(fileName.c_str(), "wb");
-    if (outfile == nullptr) {
+
+    if (threads <= 0) {
+        threads = std::max(1, (int) std::thread::hardware_concurrency());
+    }
+
+    // jpeg_set_defaults uses 2x2 chroma subsampling for color images
+    const int mcu_height = pixel_channels > 1 ? 2 * DCTSIZE : DCTSIZE;
+    const int slice_unit = kSliceMCURows * mcu_height;
+    const int slice_units = (height + slice_unit - 1) / slice_unit;
+    const int slices = std::min(threads, slice_units);
+
+    auto fdt = [](FILE* fp) { fclose(fp); };
+    std::unique_ptr<FILE, decltype(fdt)> outfile(fopen(fileName.c_str(), "wb"), fdt);
+    if (outfile.get() == nullptr) {
         throw std::runtime_error("Could not open " + fileName + " for writing");
     }
 
+    uint8_t* data = image_data().data();
+    size_t row_stride = stride * pixel_channels;
+
+    if (slices > 1) {
+        const int slice_height = slice_unit * ((slice_units + slices - 1) / slices);
+        write_jpeg_file_parallel(outfile.get(), width, height, pixel_channels, quality, data, row_stride,
+                                 (height + slice_height - 1) / slice_height, slice_height);
+        return;
+    }
+
     auto errorMgr = std::make_shared<::jpeg_error_mgr>();
 
     // Creating a custom deleter for the compressInfo pointer
@@ -121,27 +306,13 @@ void write_jpeg_file(const std::string& fileName, int width, int height, int str
     // we throw out of this function.
     auto dt = [](::jpeg_compress_struct* cs) { ::jpeg_destroy_compress(cs); };
     std::unique_ptr<::jpeg_compress_struct, decltype(dt)> compressInfo(new ::jpeg_compress_struct, dt);
-    ::jpeg_create_compress(compressInfo.get());
-    ::jpeg_stdio_dest(compressInfo.get(), outfile);
-    compressInfo->image_width = (JDIMENSION)width;
-    compressInfo->image_height = (JDIMENSION)height;
-    compressInfo->input_components = (JDIMENSION)pixel_channels;
-    compressInfo->in_color_space = static_cast<::J_COLOR_SPACE>(pixel_channels == 3 ? ::JCS_RGB : ::JCS_GRAYSCALE);
     compressInfo->err = ::jpeg_std_error(errorMgr.get());
-    ::jpeg_set_defaults(compressInfo.get());
-    ::jpeg_set_quality(compressInfo.get(), quality, TRUE);
-    ::jpeg_start_compress(compressInfo.get(), TRUE);
-
-    uint8_t* ptr = image_data().data();
-    size_t row_stride = stride * pixel_channels;
-
-    for (int line = 0; line < height; line++) {
-        ::jpeg_write_scanlines(compressInfo.get(), &ptr, 1);
-        ptr += row_stride;
-    }
+    errorMgr->error_exit = throwJpegError;
+    ::jpeg_create_compress(compressInfo.get());
+    ::jpeg_stdio_dest(compressInfo.get(), outfile.get());
 
-    ::jpeg_finish_compress(compressInfo.get());
-    fclose(outfile);
+    compressJpegImage(compressInfo.get(), width, height, pixel_channels, quality, /*restart_in_rows=*/0, data,
+                      row_stride);
 }
 
 }  // namespace gls
@@ -22,11 +22,19 @@
 
 namespace gls {
 
+// If target_width and target_height are non zero the image is decoded at the smallest DCT scale
+// factor (N/8) which still produces an image at least as large as the requested size
 void read_jpeg_file(const std::string& filename, int pixel_channels, int pixel_bit_depth,
-                    std::function<std::span<uint8_t>(int width, int height)> image_allocator);
+                    std::function<std::span<uint8_t>(int width, int height)> image_allocator,
+                    int target_width = 0, int target_height = 0);
 
+// By default the image is encoded as a single sequential scan without restart markers. Parallel encoding
+// is opt-in: with threads > 1 (0: use all available cores) large images are split in horizontal slices
+// which are encoded concurrently and stitched together using restart markers.
+// 4-channel (RGBA) images are encoded directly from their buffer, the alpha channel is ignored.
 void write_jpeg_file(const std::string& fileName, int width, int height, int stride, int pixel_channels,
-                     int pixel_bit_depth, const std::function<std::span<uint8_t>()>& image_data, int quality);
+                     int pixel_bit_depth, const std::function<std::span<uint8_t>()>& image_data, int quality,
+                     int threads = 1);
 
 }  // namespace gls
 #endif /* GLS_IMAGE_JPEG_HPP */
@@ -17,11 +17,22 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include <png.h>
 #include <zlib.h>
 
+#include "gls_parallel.hpp"
+
 namespace gls {
 
+// Amount of filtered image data deflated as an independent chunk by the parallel encoder
+static const size_t kDeflateChunkSize = 256 * 1024;
+
+// Deflate window, each chunk is primed with the tail of the previous one
+static const size_t kDeflateWindowSize = 32 * 1024;
+
 void read_png_file(const std::string& filename, int pixel_channels, int pixel_bit_depth,
                    std::function<bool(int width, int height, std::vector<uint8_t*>* row_pointers)> image_allocator) {
     FILE* fp = fopen(filename.c_str(), "rb");
@@ -91,8 +102,252 @@ void read_png_file(const std::string& filename, int pixel_channels, int pixel_bi
     fclose(fp);
 }
 
+static inline int filterCost(const uint8_t* filtered, size_t size) {
+    int cost = 0;
+    for (size_t i = 0; i < size; i++) {
+        cost += std::abs((int)(int8_t)filtered[i]);
+    }
+    return cost;
+}
+
+static inline uint8_t paethPredictor(int a, int b, int c) {
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// Filter a row choosing the filter type with the minimum sum of absolute differences, as libpng does.
+// The filters are written as straight loops over the row bytes so that the compiler can vectorize them.
+static void filterPngRow(const uint8_t* row, const uint8_t* prev_row, size_t row_bytes, int bpp, bool fast_filters,
+                         uint8_t* output, std::vector<uint8_t>* scratch) {
+    const int filter_count = fast_filters ? 3 : 5;
+    scratch->resize(filter_count * row_bytes);
+
+    const uint8_t* none = row;
+    uint8_t* sub = scratch->data();
+    uint8_t* up = sub + row_bytes;
+
+    for (int i = 0; i < bpp; i++) {
+        sub[i] = row[i];
+    }
+    for (size_t i = bpp; i < row_bytes; i++) {
+        sub[i] = row[i] - row[i - bpp];
+    }
+    for (size_t i = 0; i < row_bytes; i++) {
+        up[i] = row[i] - prev_row[i];
+    }
+
+    const uint8_t* candidates[5] = {none, sub, up, nullptr, nullptr};
+    if (!fast_filters) {
+        uint8_t* average = up + row_bytes;
+        uint8_t* paeth = average + row_bytes;
+        for (int i = 0; i < bpp; i++) {
+            average[i] = row[i] - (prev_row[i] >> 1);
+            paeth[i] = row[i] - prev_row[i];
+        }
+        for (size_t i = bpp; i < row_bytes; i++) {
+            average[i] = row[i] - (uint8_t)((row[i - bpp] + prev_row[i]) >> 1);
+        }
+        for (size_t i = bpp; i < row_bytes; i++) {
+            paeth[i] = row[i] - paethPredictor(row[i - bpp], prev_row[i], prev_row[i - bpp]);
+        }
+        candidates[3] = average;
+        candidates[4] = paeth;
+    }
+
+    int best_filter = 0;
+    int best_cost = filterCost(none, row_bytes);
+    for (int filter = 1; filter < filter_count; filter++) {
+        int cost = filterCost(candidates[filter], row_bytes);
+        if (cost < best_cost) {
+            best_cost = cost;
+            best_filter = filter;
+        }
+    }
+
+    output[0] = (uint8_t)best_filter;
+    std::copy(candidates[best_filter], candidates[best_filter] + row_bytes, output + 1);
+}
+
+// Convert a source row to the PNG layout: optionally strip the alpha channel and store 16-bit samples big-endian
+static void packPngRow(const uint8_t* source, int width, int pixel_channels, int pixel_bit_depth, bool skip_alpha,
+                       uint8_t* output) {
+    const int sample_bytes = pixel_bit_depth / 8;
+    const int output_channels = skip_alpha ? pixel_channels - 1 : pixel_channels;
+    const bool swap_bytes = sample_bytes == 2 && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+    if (output_channels == pixel_channels && !swap_bytes) {
+        std::copy(source, source + width * pixel_channels * sample_bytes, output);
+        return;
+    }
+
+    for (int x = 0; x < width; x++) {
+        for (int c = 0; c < output_channels; c++) {
+            const uint8_t* sample = source + (x * pixel_channels + c) * sample_bytes;
+            if (swap_bytes) {
+                *output++ = sample[1];
+                *output++ = sample[0];
+            } else {
+                for (int b = 0; b < sample_bytes; b++) {
+                    *output++ = sample[b];
+                }
+            }
+        }
+    }
+}
+
+static void writePngChunk(FILE* fp, const char type[4], const uint8_t* data, size_t size) {
+    const uint8_t length[4] = {(uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+    uLong crc = crc32(0, (const Bytef*)type, 4);
+    if (size > 0) {
+        crc = crc32(crc, data, (uInt)size);
+    }
+    const uint8_t crc_bytes[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    fwrite(length, 1, 4, fp);
+    fwrite(type, 1, 4, fp);
+    if (size > 0) {
+        fwrite(data, 1, size, fp);
+    }
+    fwrite(crc_bytes, 1, 4, fp);
+}
+
+// pigz style encoder: rows are filtered concurrently, then the filtered data is split into chunks deflated
+// independently (each primed with the previous chunk's tail as dictionary, sync flushed to a byte boundary)
+// and concatenated into a single zlib stream stored as a sequence of IDAT chunks.
+static void write_png_file_parallel(FILE* fp, int width, int height, int pixel_channels, int pixel_bit_depth,
+                                    bool skip_alpha, int compression_level, int threads, int chunk_rows,
+                                    const std::function<uint8_t*(int row)>& row_pointer) {
+    const int output_channels = skip_alpha ? pixel_channels - 1 : pixel_channels;
+    const int bpp = output_channels * pixel_bit_depth / 8;
+    const size_t row_bytes = (size_t)width * bpp;
+    const size_t filtered_row_bytes = row_bytes + 1;
+    const bool fast_filters = compression_level <= 1;
+
+    // Filter the image in horizontal bands
+    std::vector<uint8_t> filtered(filtered_row_bytes * height);
+    const int bands = std::min(threads, height);
+    parallel_for(bands, threads, [&](int band) {
+        const int first_row = (int)((int64_t)height * band / bands);
+        const int last_row = (int)((int64_t)height * (band + 1) / bands);
+        std::vector<uint8_t> packed_rows[2] = {std::vector<uint8_t>(row_bytes), std::vector<uint8_t>(row_bytes, 0)};
+        std::vector<uint8_t> scratch;
+        if (first_row > 0) {
+            packPngRow(row_pointer(first_row - 1), width, pixel_channels, pixel_bit_depth, skip_alpha,
+                       packed_rows[1].data());
+        }
+        for (int row = first_row; row < last_row; row++) {
+            std::swap(packed_rows[0], packed_rows[1]);
+            packPngRow(row_pointer(row), width, pixel_channels, pixel_bit_depth, skip_alpha, packed_rows[1].data());
+            filterPngRow(packed_rows[1].data(), packed_rows[0].data(), row_bytes, bpp, fast_filters,
+                         filtered.data() + filtered_row_bytes * row, &scratch);
+        }
+    });
+
+    // Deflate the chunks
+    const int chunks = (height + chunk_rows - 1) / chunk_rows;
+    std::vector<std::vector<uint8_t>> compressed(chunks);
+    std::vector<uLong> checksums(chunks);
+    std::atomic<bool> failed = false;
+    parallel_for(chunks, threads, [&](int chunk) {
+        const size_t begin = filtered_row_bytes * chunk * chunk_rows;
+        const size_t end = std::min(filtered.size(), filtered_row_bytes * (chunk + 1) * chunk_rows);
+        const bool last_chunk = chunk == chunks - 1;
+
+        z_stream stream = {};
+        if (deflateInit2(&stream, compression_level, Z_DEFLATED, /*raw deflate=*/-15, /*memLevel=*/9,
+                         fast_filters ? Z_RLE : Z_DEFAULT_STRATEGY) != Z_OK) {
+            failed = true;
+            return;
+        }
+        if (begin > 0) {
+            const size_t dictionary_size = std::min(begin, kDeflateWindowSize);
+            deflateSetDictionary(&stream, filtered.data() + begin - dictionary_size, (uInt)dictionary_size);
+        }
+
+        auto& output = compressed[chunk];
+        output.resize(deflateBound(&stream, (uLong)(end - begin)) + 16);
+        stream.next_in = filtered.data() + begin;
+        stream.avail_in = (uInt)(end - begin);
+        stream.next_out = output.data();
+        stream.avail_out = (uInt)output.size();
+        int result = deflate(&stream, last_chunk ? Z_FINISH : Z_SYNC_FLUSH);
+        // A sync flush which fills the output buffer may not be complete
+        if (result != (last_chunk ? Z_STREAM_END : Z_OK) || stream.avail_in != 0 ||
+            (!last_chunk && stream.avail_out == 0)) {
+            failed = true;
+        }
+        output.resize(stream.total_out);
+        deflateEnd(&stream);
+
+        checksums[chunk] = adler32(adler32(0, nullptr, 0), filtered.data() + begin, (uInt)(end - begin));
+    });
+    if (failed) {
+        throw std::runtime_error("PNG deflate error");
+    }
+
+    static const uint8_t png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(png_signature, 1, sizeof(png_signature), fp);
+
+    const int color_type = output_channels == 1   ? PNG_COLOR_TYPE_GRAY
+                           : output_channels == 2 ? PNG_COLOR_TYPE_GRAY_ALPHA
+                           : output_channels == 3 ? PNG_COLOR_TYPE_RGB
+                                                  : PNG_COLOR_TYPE_RGB_ALPHA;
+    const uint8_t ihdr[13] = {
+        (uint8_t)(width >> 24),  (uint8_t)(width >> 16),  (uint8_t)(width >> 8),  (uint8_t)width,
+        (uint8_t)(height >> 24), (uint8_t)(height >> 16), (uint8_t)(height >> 8), (uint8_t)height,
+        (uint8_t)pixel_bit_depth, (uint8_t)color_type, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT,
+        PNG_INTERLACE_NONE};
+    writePngChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+
+    // zlib stream header, the compression level hint follows zlib's own deflateInit
+    const int level = compression_level < 0 ? Z_DEFAULT_COMPRESSION : compression_level;
+    const int level_flags = level == Z_DEFAULT_COMPRESSION ? 2 : level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    uint8_t zlib_header[2] = {0x78, (uint8_t)(level_flags << 6)};
+    zlib_header[1] += 31 - (zlib_header[0] * 256 + zlib_header[1]) % 31;
+
+    uLong checksum = checksums[0];
+    for (int chunk = 1; chunk < chunks; chunk++) {
+        const size_t chunk_size = std::min(filtered.size(), filtered_row_bytes * (chunk + 1) * chunk_rows) -
+                                  filtered_row_bytes * chunk * chunk_rows;
+        checksum = adler32_combine(checksum, checksums[chunk], (z_off_t)chunk_size);
+    }
+    const uint8_t zlib_trailer[4] = {(uint8_t)(checksum >> 24), (uint8_t)(checksum >> 16), (uint8_t)(checksum >> 8),
+                                     (uint8_t)checksum};
+
+    compressed[0].insert(compressed[0].begin(), zlib_header, zlib_header + sizeof(zlib_header));
+    compressed[chunks - 1].insert(compressed[chunks - 1].end(), zlib_trailer, zlib_trailer + sizeof(zlib_trailer));
+    for (const auto& data : compressed) {
+        if (!data.empty()) {
+            writePngChunk(fp, "IDAT", data.data(), data.size());
+        }
+    }
+    writePngChunk(fp, "IEND", nullptr, 0);
+
+    if (ferror(fp)) {
+        throw std::runtime_error("Error writing PNG file");
+    }
+}
+
 void write_png_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
-                    bool skip_alpha, int compression_level, std::function<uint8_t*(int row)> row_pointer) {
+                    bool skip_alpha, int compression_level, std::function<uint8_t*(int row)> row_pointer, int threads) {
+    threads = parallel_threads(threads);
+    skip_alpha = skip_alpha && (pixel_channels == 2 || pixel_channels == 4);
+
+    const size_t filtered_row_bytes =
+        (size_t)width * (skip_alpha ? pixel_channels - 1 : pixel_channels) * pixel_bit_depth / 8 + 1;
+    const int chunk_rows = (int)std::max((size_t)1, kDeflateChunkSize / filtered_row_bytes);
+    if (threads > 1 && height > chunk_rows && pixel_bit_depth >= 8) {
+        FILE* fp = fopen(filename.c_str(), "wb");
+        if (!fp) {
+            throw std::runtime_error("Could not open " + filename);
+        }
+        std::unique_ptr<FILE, decltype(&fclose)> file(fp, &fclose);
+        write_png_file_parallel(fp, width, height, pixel_channels, pixel_bit_depth, skip_alpha, compression_level,
+                                threads, chunk_rows, row_pointer);
+        return;
+    }
+
     FILE* fp = fopen(filename.c_str(), "wb");
     if (!fp) {
         throw std::runtime_error("Could not open " + filename);
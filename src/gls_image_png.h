@@ -25,8 +25,12 @@ namespace gls {
 void read_png_file(const std::string& filename, int pixel_channels, int pixel_bit_depth,
                    std::function<bool(int width, int height, std::vector<uint8_t*>* row_pointers)> image_allocator);
 
+// By default the image is written sequentially by libpng. Chunked compression is opt-in: with threads > 1
+// (0: use all available cores) images larger than a single deflate chunk are filtered and compressed
+// concurrently.
 void write_png_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
-                    bool skip_alpha, int compression_level, std::function<uint8_t*(int row)> row_pointer);
+                    bool skip_alpha, int compression_level, std::function<uint8_t*(int row)> row_pointer,
+                    int threads = 1);
 
 }  // namespace gls
 
@@ -18,6 +18,7 @@
 #include <assert.h>
 
 #include <tiffio.h>
+#include <zlib.h>
 #include <math.h>
 #include <float.h>
 #include <span>
@@ -25,6 +26,18 @@
 #include <sys/stat.h>
 #include <sys/time.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <variant>
@@ -33,87 +46,286 @@
 
 #include "gls_dng_lossless_jpeg.hpp"
 #include "gls_auto_ptr.hpp"
+#include "gls_mapped_file.hpp"
+#include "gls_parallel.hpp"
 #include "gls_tiff_metadata.hpp"
 
 namespace gls {
 
-inline static uint16_t swapBytes(uint16_t in) {
-    return ((in & 0xff) << 8) | (in >> 8);
+// Unpacking of 10, 12 and 14 bit packed samples into 16 bit words. Samples are packed MSB first, the TIFF/DNG bit order.
+//
+// The vector paths unpack 8 samples (bits bytes) per iteration: every sample is gathered into a 32 bit
+// lane from the (up to) 4 bytes which contain it, shifted left to drop the bits of the previous sample and
+// shifted right to drop the bits of the next one.
+
+static void unpackBitsInto16BitsScalar(uint16_t *out, const uint8_t *in, size_t count, int bits) {
+    const uint32_t mask = (1 << bits) - 1;
+    uint64_t accumulator = 0;
+    int available_bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (available_bits < bits) {
+            accumulator = (accumulator << 8) | *in++;
+            available_bits += 8;
+        }
+        out[i] = (accumulator >> (available_bits - bits)) & mask;
+        available_bits -= bits;
+    }
 }
 
-int findGcd(int a, int b) {
-  while ((a % b) > 0) {
-    int R = a % b;
-    a = b;
-    b = R;
-  }
-  return b;
+#if defined(__AVX2__) || defined(__SSE4_1__) || defined(__aarch64__)
+#define GLS_SIMD_UNPACK 1
+
+struct unpack_lanes {
+    uint8_t shuffle[2][16];     // Byte gather for samples 0-3 and 4-7
+    uint32_t left_shift[8];     // Per sample left shift aligning the sample's MSB to bit 31
+};
+
+static unpack_lanes unpackLanes(int bits) {
+    unpack_lanes lanes;
+    for (int i = 0; i < 8; i++) {
+        const int bit_offset = i * bits;
+        const int byte_offset = bit_offset / 8;
+        const int shift = bit_offset % 8;
+        for (int b = 0; b < 4; b++) {
+            lanes.shuffle[i / 4][4 * (i % 4) + b] = (uint8_t) (byte_offset + 3 - b);
+        }
+        lanes.left_shift[i] = shift;
+    }
+    return lanes;
 }
-
-inline static void unpack12BitsInto16Bits(uint16_t *out, const uint16_t *in, size_t in_size) {
-    for (int i = 0; i < in_size; i += 3) {
-        uint16_t in0 = swapBytes(in[i]);
-        uint16_t in1 = swapBytes(in[i+1]);
-        uint16_t in2 = swapBytes(in[i+2]);
-
-        *out++ = in0 >> 4;
-        *out++ = ((in0 << 8) & 0xfff) | (in1 >> 8);
-        *out++ = ((in1 << 4) & 0xfff) | (in2 >> 12);
-        *out++ = in2 & 0xfff;
+#endif
+
+#if defined(__AVX2__)
+static size_t unpackBitsInto16BitsSIMD(uint16_t *out, const uint8_t *in, size_t count, size_t in_size, int bits) {
+    const auto lanes = unpackLanes(bits);
+    const __m256i shuffle = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) lanes.shuffle[0])),
+        _mm_loadu_si128((const __m128i*) lanes.shuffle[1]), 1);
+    const __m256i left_shift = _mm256_loadu_si256((const __m256i*) lanes.left_shift);
+    const __m128i right_shift = _mm_cvtsi32_si128(32 - bits);
+
+    size_t i = 0;
+    for (; i + 8 <= count && (i / 8) * bits + 16 <= in_size; i += 8) {
+        __m256i data = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) (in + (i / 8) * bits)));
+        __m256i samples = _mm256_srl_epi32(_mm256_sllv_epi32(_mm256_shuffle_epi8(data, shuffle), left_shift),
+                                           right_shift);
+        __m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(samples), _mm256_extracti128_si256(samples, 1));
+        _mm_storeu_si128((__m128i*) (out + i), packed);
+    }
+    return i;
+}
+#elif defined(__SSE4_1__)
+static size_t unpackBitsInto16BitsSIMD(uint16_t *out, const uint8_t *in, size_t count, size_t in_size, int bits) {
+    const auto lanes = unpackLanes(bits);
+    const __m128i shuffle_lo = _mm_loadu_si128((const __m128i*) lanes.shuffle[0]);
+    const __m128i shuffle_hi = _mm_loadu_si128((const __m128i*) lanes.shuffle[1]);
+    // No variable shifts in SSE4, shift left multiplying by powers of two
+    uint32_t multipliers[8];
+    for (int j = 0; j < 8; j++) {
+        multipliers[j] = 1u << lanes.left_shift[j];
+    }
+    const __m128i multiplier_lo = _mm_loadu_si128((const __m128i*) multipliers);
+    const __m128i multiplier_hi = _mm_loadu_si128((const __m128i*) (multipliers + 4));
+    const __m128i right_shift = _mm_cvtsi32_si128(32 - bits);
+
+    size_t i = 0;
+    for (; i + 8 <= count && (i / 8) * bits + 16 <= in_size; i += 8) {
+        __m128i data = _mm_loadu_si128((const __m128i*) (in + (i / 8) * bits));
+        __m128i lo = _mm_srl_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(data, shuffle_lo), multiplier_lo), right_shift);
+        __m128i hi = _mm_srl_epi32(_mm_mullo_epi32(_mm_shuffle_epi8(data, shuffle_hi), multiplier_hi), right_shift);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi32(lo, hi));
     }
+    return i;
+}
+#elif defined(__aarch64__)
+static size_t unpackBitsInto16BitsSIMD(uint16_t *out, const uint8_t *in, size_t count, size_t in_size, int bits) {
+    const auto lanes = unpackLanes(bits);
+    const uint8x16_t shuffle_lo = vld1q_u8(lanes.shuffle[0]);
+    const uint8x16_t shuffle_hi = vld1q_u8(lanes.shuffle[1]);
+    const int32x4_t left_shift_lo = vreinterpretq_s32_u32(vld1q_u32(lanes.left_shift));
+    const int32x4_t left_shift_hi = vreinterpretq_s32_u32(vld1q_u32(lanes.left_shift + 4));
+    const int32x4_t right_shift = vdupq_n_s32(bits - 32);
+
+    size_t i = 0;
+    for (; i + 8 <= count && (i / 8) * bits + 16 <= in_size; i += 8) {
+        uint8x16_t data = vld1q_u8(in + (i / 8) * bits);
+        uint32x4_t lo = vreinterpretq_u32_u8(vqtbl1q_u8(data, shuffle_lo));
+        uint32x4_t hi = vreinterpretq_u32_u8(vqtbl1q_u8(data, shuffle_hi));
+        lo = vshlq_u32(vshlq_u32(lo, left_shift_lo), right_shift);
+        hi = vshlq_u32(vshlq_u32(hi, left_shift_hi), right_shift);
+        vst1q_u16(out + i, vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+    }
+    return i;
+}
+#endif
+
+// Unpack 'count' samples of 'bits' (10, 12 or 14) bits, reading at most 'in_size' bytes of input
+static void unpackBitsInto16Bits(uint16_t *out, const uint8_t *in, size_t count, size_t in_size, int bits) {
+    assert(bits == 10 || bits == 12 || bits == 14);
+    assert((count * bits + 7) / 8 <= in_size);
+
+    size_t unpacked = 0;
+#if GLS_SIMD_UNPACK
+    unpacked = unpackBitsInto16BitsSIMD(out, in, count, in_size, bits);
+#endif
+    // Leftovers start at a byte boundary, since the SIMD path works on groups of 8 samples
+    unpackBitsInto16BitsScalar(out + unpacked, in + unpacked * bits / 8, count - unpacked, bits);
 }
 
-inline static void unpack14BitsInto16Bits(uint16_t *out, const uint16_t *in, size_t in_size) {
-    for (int i = 0; i < in_size; i += 7) {
-        uint16_t in0 = swapBytes(in[i]);
-        uint16_t in1 = swapBytes(in[i+1]);
-        uint16_t in2 = swapBytes(in[i+2]);
-        uint16_t in3 = swapBytes(in[i+3]);
-        uint16_t in4 = swapBytes(in[i+4]);
-        uint16_t in5 = swapBytes(in[i+5]);
-        uint16_t in6 = swapBytes(in[i+6]);
-
-        *out++ = in0 >> 2;
-        *out++ = ((in0 << 12) & 0x3fff) | (in1 >> 4);
-        *out++ = ((in1 << 10) & 0x3fff) | (in2 >> 6);
-        *out++ = ((in2 <<  8) & 0x3fff) | (in3 >> 8);
-        *out++ = ((in3 <<  6) & 0x3fff) | (in4 >> 10);
-        *out++ = ((in4 <<  4) & 0x3fff) | (in5 >> 12);
-        *out++ = ((in5 <<  2) & 0x3fff) | (in6 >> 14);
-        *out++ = (in6 & 0x3fff);
+// Pack 16 bit samples into 'bits' (10, 12 or 14) bits, MSB first (the TIFF/DNG bit order), padding the last byte
+static void pack16BitsIntoBits(uint8_t *out, const uint16_t *in, size_t count, int bits) {
+    const uint32_t mask = (1 << bits) - 1;
+    uint64_t accumulator = 0;
+    int available_bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        accumulator = (accumulator << bits) | (in[i] & mask);
+        available_bits += bits;
+        while (available_bits >= 8) {
+            *out++ = (uint8_t)(accumulator >> (available_bits - 8));
+            available_bits -= 8;
+        }
+    }
+    if (available_bits > 0) {
+        *out = (uint8_t)(accumulator << (8 - available_bits));
     }
 }
 
-// TODO: finish building a general unpacking function
-/*
-inline static void unpackTo16Bits(uint16_t *out, const uint16_t *in, int bitspersample, size_t in_size) {
-    int gcd = findGcd(16, bitspersample);
+// Unpack packed TIFF scanlines, each scanline starts at a byte boundary. With scale_to_16_bits the samples are shifted
+// to the full 16 bit range, otherwise they keep their original values (e.g.: raw data with a white level).
+static void unpackTiffRows(uint16_t *out, const uint8_t *in, int row_samples, int rows, int bits,
+                           bool scale_to_16_bits = false) {
+    const size_t row_bytes = ((size_t) row_samples * bits + 7) / 8;
+    for (int y = 0; y < rows; y++) {
+        uint16_t *out_row = out + (size_t) y * row_samples;
+        unpackBitsInto16Bits(out_row, in + y * row_bytes, row_samples, row_bytes, bits);
+        if (scale_to_16_bits) {
+            const int shift = 16 - bits;
+            for (int i = 0; i < row_samples; i++) {
+                out_row[i] <<= shift;
+            }
+        }
+    }
+}
 
-    std::cout << "gcd: " << gcd << std::endl;
+// Unpack the strip data if needed and hand it over to the strip processor. Packed 10, 12 and 14 bit samples are handed
+// over as 16 bit samples, scaled to the 16 bit range with scale_to_16_bits (TIFF images) or not (DNG raw data).
+static void processTiffStripData(int width, int row, int nrow, int tiff_bitspersample, int tiff_samplesperpixel,
+                                 uint8_t* strip_data, size_t strip_data_size, uint8_t* unpack_buffer,
+                                 bool scale_to_16_bits, const tiff_strip_procesor& process_tiff_strip) {
+    if (tiff_bitspersample == 10 || tiff_bitspersample == 12 || tiff_bitspersample == 14) {
+        assert(strip_data_size >= nrow * (((size_t) width * tiff_samplesperpixel * tiff_bitspersample + 7) / 8));
+        unpackTiffRows((uint16_t*) unpack_buffer, strip_data, width * tiff_samplesperpixel, nrow, tiff_bitspersample,
+                       scale_to_16_bits);
+
+        process_tiff_strip(/* tiff_bitspersample=*/ 16, tiff_samplesperpixel, row,
+                           /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, unpack_buffer);
+    } else if (tiff_bitspersample == 16) {
+        process_tiff_strip(/* tiff_bitspersample=*/ 16, tiff_samplesperpixel, row,
+                           /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, strip_data);
+    } else if (tiff_bitspersample == 8) {
+        process_tiff_strip(/* tiff_bitspersample=*/ 8, tiff_samplesperpixel, row,
+                           /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, strip_data);
+    } else {
+        throw std::runtime_error("tiff_bitspersample " + std::to_string(tiff_bitspersample) + " not supported.");
+    }
+}
 
-    int inputWords = bitspersample / gcd;
-    int outputWords = 16 / gcd;
+// Uncompressed strips are processed (or unpacked) straight from the memory mapped file
+static bool readMappedTiffImageData(TIFF *tif, int width, int height, int tiff_bitspersample,
+                                    int tiff_samplesperpixel, uint32_t rowsperstrip, bool scale_to_16_bits,
+                                    const tiff_strip_procesor& process_tiff_strip) {
+    mapped_file file(TIFFFileName(tif));
+    if (!file.data) {
+        return false;
+    }
 
-    std::cout << "inputWords: " << inputWords << ", outputWords: " << outputWords << std::endl;
+    const int strips = (height + rowsperstrip - 1) / rowsperstrip;
+    const size_t row_bytes = ((size_t) width * tiff_samplesperpixel * tiff_bitspersample + 7) / 8;
+    const bool packed = tiff_bitspersample % 8 != 0;
+    for (int strip = 0; strip < strips; strip++) {
+        const uint32_t nrow = std::min(rowsperstrip, height - strip * rowsperstrip);
+        const uint64_t offset = TIFFGetStrileOffset(tif, strip);
+        if (TIFFGetStrileByteCount(tif, strip) < nrow * row_bytes || offset + nrow * row_bytes > file.size) {
+            return false;
+        }
+    }
 
-    uint16_t inputBuffer[inputWords];
-    uint16_t outputBuffer[outputWords];
+    parallel_for(strips, parallel_threads(0), [&](int strip) {
+        const uint32_t row = strip * rowsperstrip;
+        const uint32_t nrow = std::min(rowsperstrip, height - row);
+        // The strip processor only reads from its input buffer
+        uint8_t* strip_data = file.data + TIFFGetStrileOffset(tif, strip);
+        std::vector<uint16_t> unpack_buffer(packed ? (size_t) nrow * width * tiff_samplesperpixel : 0);
+        processTiffStripData(width, row, nrow, tiff_bitspersample, tiff_samplesperpixel, strip_data,
+                             nrow * row_bytes, (uint8_t*) unpack_buffer.data(), scale_to_16_bits, process_tiff_strip);
+    });
+    return true;
+}
 
-    for (int i = 0; i < in_size; i += inputWords) {
-        for (int j = 0; j < inputWords; j++) {
-            inputBuffer[j] = swapBytes(in[i + j]);
+// Compressed strips are decoded concurrently, each worker reading a band of strips with its own TIFF handle
+static void readTiffImageDataParallel(TIFF *tif, int width, int height, int tiff_bitspersample,
+                                      int tiff_samplesperpixel, uint32_t rowsperstrip, int threads,
+                                      bool scale_to_16_bits, const tiff_strip_procesor& process_tiff_strip) {
+    const std::string filename = TIFFFileName(tif);
+    const uint64_t directory_offset = TIFFCurrentDirOffset(tif);
+    const size_t stripSize = TIFFStripSize(tif);
+    const int strips = (height + rowsperstrip - 1) / rowsperstrip;
+    const int workers = std::min(threads, strips);
+
+    parallel_for(workers, workers, [&](int worker) {
+        auto_ptr<TIFF> worker_tif(TIFFOpen(filename.c_str(), "r"),
+                                  [](TIFF *tif) { TIFFClose(tif); });
+        if (!worker_tif || !TIFFSetSubDirectory(worker_tif, directory_offset)) {
+            throw std::runtime_error("Couldn't read tiff file.");
         }
 
-        int shift = 16 - bitspersample;
-        for (int k = 0; k < outputWords; k++) {
+        std::vector<uint8_t> tiffbuf(stripSize);
+        std::vector<uint8_t> decodedBuffer(tiff_bitspersample != 16 ? 16 * stripSize / tiff_bitspersample : 0);
 
+        for (int strip = strips * worker / workers; strip < strips * (worker + 1) / workers; strip++) {
+            const uint32_t row = strip * rowsperstrip;
+            const uint32_t nrow = std::min(rowsperstrip, height - row);
+            if (TIFFReadEncodedStrip(worker_tif, strip, tiffbuf.data(), -1) < 0) {
+                throw std::runtime_error("Failed to encode TIFF strip.");
+            }
+            processTiffStripData(width, row, nrow, tiff_bitspersample, tiff_samplesperpixel, tiffbuf.data(),
+                                 stripSize, decodedBuffer.data(), scale_to_16_bits, process_tiff_strip);
         }
-    }
+    });
 }
-*/
+
 static void readTiffImageData(TIFF *tif, int width, int height, int tiff_bitspersample, int tiff_samplesperpixel,
-                              tiff_strip_procesor process_tiff_strip) {
+                              bool scale_to_16_bits, tiff_strip_procesor process_tiff_strip) {
     size_t stripSize = TIFFStripSize(tif);
+
+    printf("stripSize: %ld, width: %d\n", stripSize, width);
+
+    uint32_t rowsperstrip = 0;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+    rowsperstrip = std::min(rowsperstrip, (uint32_t) height);
+
+    uint16_t compression = COMPRESSION_NONE;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_COMPRESSION, &compression);
+    uint16_t planarconfig = PLANARCONFIG_CONTIG;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planarconfig);
+    uint16_t fillorder = FILLORDER_MSB2LSB;
+    TIFFGetFieldDefaulted(tif, TIFFTAG_FILLORDER, &fillorder);
+
+    const int strips = (height + rowsperstrip - 1) / rowsperstrip;
+    const int threads = parallel_threads(0);
+    if (planarconfig == PLANARCONFIG_CONTIG && fillorder == FILLORDER_MSB2LSB && TIFFIsTiled(tif) == 0) {
+        if (compression == COMPRESSION_NONE && (tiff_bitspersample != 16 || !TIFFIsByteSwapped(tif))) {
+            if (readMappedTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, rowsperstrip,
+                                        scale_to_16_bits, process_tiff_strip)) {
+                return;
+            }
+        } else if (compression != COMPRESSION_NONE && strips > 1 && threads > 1) {
+            readTiffImageDataParallel(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, rowsperstrip,
+                                      threads, scale_to_16_bits, process_tiff_strip);
+            return;
+        }
+    }
+
     auto_ptr<uint8_t> tiffbuf((uint8_t*)_TIFFmalloc(stripSize),
                               [](uint8_t* tiffbuf) { _TIFFfree(tiffbuf); });
 
@@ -122,12 +334,7 @@ static void readTiffImageData(TIFF *tif, int width, int height, int tiff_bitsper
                                                          [](uint8_t* buffer) { _TIFFfree(buffer); })
                                     : auto_ptr<uint8_t>(nullptr, [](uint8_t* buffer){ });
 
-    printf("stripSize: %ld, width: %d\n", stripSize, width);
-
     if (tiffbuf) {
-        uint32_t rowsperstrip = 0;
-        TIFFGetField(tif, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
-
         for (uint32_t row = 0; row < height; row += rowsperstrip) {
             uint32_t nrow = (row + rowsperstrip > height) ? (height - row) : rowsperstrip;
             tstrip_t strip = TIFFComputeStrip(tif, row, 0);
@@ -136,25 +343,8 @@ static void readTiffImageData(TIFF *tif, int width, int height, int tiff_bitsper
                 throw std::runtime_error("Failed to encode TIFF strip.");
             }
 
-            if (tiff_bitspersample == 12) {
-                unpack12BitsInto16Bits((uint16_t*) decodedBuffer.get(), (uint16_t*) tiffbuf.get(), stripSize / sizeof(uint16_t));
-
-                process_tiff_strip(/* tiff_bitspersample=*/ 16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, decodedBuffer);
-            } else if (tiff_bitspersample == 14) {
-                unpack14BitsInto16Bits((uint16_t*) decodedBuffer.get(), (uint16_t*) tiffbuf.get(), stripSize / sizeof(uint16_t));
-
-                process_tiff_strip(/* tiff_bitspersample=*/ 16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, decodedBuffer);
-            } else if (tiff_bitspersample == 16) {
-                process_tiff_strip(/* tiff_bitspersample=*/ 16, tiff_samplesperpixel, row,
-                                   /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, tiffbuf);
-            } else if (tiff_bitspersample == 8) {
-                process_tiff_strip(/* tiff_bitspersample=*/ 8, tiff_samplesperpixel, row,
-                                   /*strip_width=*/ width, /*strip_height=*/ nrow, /*crop_x=*/ 0, /*crop_y=*/ 0, tiffbuf);
-            } else {
-                throw std::runtime_error("tiff_bitspersample " + std::to_string(tiff_bitspersample) + " not supported.");
-            }
+            processTiffStripData(width, row, nrow, tiff_bitspersample, tiff_samplesperpixel, tiffbuf, stripSize,
+                                 decodedBuffer, scale_to_16_bits, process_tiff_strip);
         }
     } else {
         throw std::runtime_error("Error allocating memory buffer for TIFF strip.");
@@ -183,13 +373,15 @@ void read_tiff_file(const std::string& filename, int pixel_channels, int pixel_b
 
         uint16_t tiff_bitspersample;
         TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &tiff_bitspersample);
-        if ((tiff_bitspersample != 8 && tiff_bitspersample != 16)) {
+        if (tiff_bitspersample != 8 && tiff_bitspersample != 10 && tiff_bitspersample != 12 &&
+            tiff_bitspersample != 14 && tiff_bitspersample != 16) {
             throw std::runtime_error("can not read sample with " + std::to_string(tiff_bitspersample) + " bits depth");
         }
 
         auto allocation_successful = image_allocator(width, height);
         if (allocation_successful) {
-            readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip);
+            readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, /*scale_to_16_bits=*/ true,
+                              process_tiff_strip);
         } else {
             throw std::runtime_error("Couldn't allocate image storage");
         }
@@ -198,28 +390,163 @@ void read_tiff_file(const std::string& filename, int pixel_channels, int pixel_b
     }
 }
 
+// TIFF flavor of LZW (MSB first codes, code width bumped one code early), matching libtiff's own encoder
+static void lzwEncode(const uint8_t* data, size_t size, std::vector<uint8_t>* output) {
+    static const int kClearCode = 256;
+    static const int kEndOfInformation = 257;
+    static const int kFirstCode = 258;
+    static const int kMaxCode = 4095;
+    static const int kHashSize = 9001;
+
+    std::vector<int32_t> hash_keys(kHashSize);
+    std::vector<uint16_t> hash_codes(kHashSize);
+    int next_code = kFirstCode;
+    int code_bits = 9;
+    int max_code = (1 << code_bits) - 1;
+
+    uint32_t bit_buffer = 0;
+    int bit_count = 0;
+    auto putCode = [&](int code) {
+        bit_buffer = (bit_buffer << code_bits) | code;
+        bit_count += code_bits;
+        while (bit_count >= 8) {
+            output->push_back((uint8_t)(bit_buffer >> (bit_count - 8)));
+            bit_count -= 8;
+        }
+    };
+    auto resetTable = [&]() {
+        std::fill(hash_keys.begin(), hash_keys.end(), -1);
+        next_code = kFirstCode;
+        code_bits = 9;
+        max_code = (1 << code_bits) - 1;
+    };
+    // Account for a newly assigned code, resetting the string table when it is full
+    auto addCode = [&]() {
+        if (++next_code == kMaxCode - 1) {
+            putCode(kClearCode);
+            resetTable();
+        } else if (next_code > max_code) {
+            max_code = (1 << ++code_bits) - 1;
+        }
+    };
+
+    resetTable();
+    putCode(kClearCode);
+    if (size > 0) {
+        int prefix = data[0];
+        for (size_t i = 1; i < size; i++) {
+            const int32_t key = (prefix << 8) | data[i];
+            int h = (int)(((uint32_t)key * 2654435761u) % kHashSize);
+            while (hash_keys[h] != -1 && hash_keys[h] != key) {
+                h = h + 1 < kHashSize ? h + 1 : 0;
+            }
+            if (hash_keys[h] == key) {
+                prefix = hash_codes[h];
+                continue;
+            }
+            putCode(prefix);
+            prefix = data[i];
+            hash_keys[h] = key;
+            hash_codes[h] = (uint16_t)next_code;
+            addCode();
+        }
+        putCode(prefix);
+        addCode();
+    }
+    putCode(kEndOfInformation);
+    if (bit_count > 0) {
+        output->push_back((uint8_t)(bit_buffer << (8 - bit_count)));
+    }
+}
+
+static bool compressTiffStrip(uint16_t compression, const uint8_t* data, size_t size, std::vector<uint8_t>* output) {
+    if (compression == COMPRESSION_LZW) {
+        output->reserve(size / 2);
+        lzwEncode(data, size, output);
+        return true;
+    }
+    // Deflate strips are plain zlib streams, as written by libtiff's ZIP codec at its default quality
+    uLongf compressed_size = compressBound((uLong)size);
+    output->resize(compressed_size);
+    if (compress2(output->data(), &compressed_size, data, (uLong)size, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    output->resize(compressed_size);
+    return true;
+}
+
 template <typename T>
 static void writeTiffImageData(TIFF *tif, int width, int height, int pixel_channels, int pixel_bit_depth,
                         std::function<T*(int row)> row_pointer) {
     uint32_t rowsperstrip = TIFFDefaultStripSize(tif, -1);
     TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
 
-    auto_ptr<T> tiffbuf((T*)_TIFFmalloc(TIFFStripSize(tif)),
-                        [](T* tiffbuf) { _TIFFfree(tiffbuf); });
+    // 16 bit samples can be written packed at a lower bit depth, each row starting at a byte boundary
+    const bool packed = pixel_bit_depth < 8 * (int) sizeof(T);
+    if (packed && (sizeof(T) != 2 || (pixel_bit_depth != 10 && pixel_bit_depth != 12 && pixel_bit_depth != 14))) {
+        throw std::runtime_error("Can't pack " + std::to_string(8 * sizeof(T)) + " bit samples into " +
+                                 std::to_string(pixel_bit_depth) + " bits.");
+    }
+
+    // Image rows are contiguous, copy them into the strip buffer in one go
+    const size_t row_samples = (size_t) width * pixel_channels;
+    const size_t row_bytes = packed ? (row_samples * pixel_bit_depth + 7) / 8 : row_samples * sizeof(T);
+    auto fillStrip = [&](uint8_t* strip_buffer, int row, int nrow) {
+        for (int y = 0; y < nrow; ++y) {
+            const T* row_data = row_pointer(row + y);
+            if (packed) {
+                pack16BitsIntoBits(strip_buffer + y * row_bytes, (const uint16_t*) row_data, row_samples,
+                                   pixel_bit_depth);
+            } else {
+                std::copy(row_data, row_data + row_samples, (T*) (strip_buffer + y * row_bytes));
+            }
+        }
+    };
+
+    uint16_t compression = COMPRESSION_NONE;
+    TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression);
+    uint16_t predictor = PREDICTOR_NONE;
+    const bool parallel_compression = compression == COMPRESSION_LZW || compression == COMPRESSION_ADOBE_DEFLATE ||
+                                      compression == COMPRESSION_DEFLATE;
+    if (parallel_compression) {
+        TIFFGetField(tif, TIFFTAG_PREDICTOR, &predictor);
+    }
+
+    const int strips = (height + rowsperstrip - 1) / rowsperstrip;
+    if (parallel_compression && strips > 1 && predictor == PREDICTOR_NONE) {
+        // Compress the strips concurrently into memory and write them out in order
+        std::vector<std::vector<uint8_t>> compressed_strips(strips);
+        std::atomic<bool> failed = false;
+        parallel_for(strips, parallel_threads(0), [&](int strip) {
+            const int row = strip * rowsperstrip;
+            const int nrow = std::min((int) rowsperstrip, height - row);
+            std::vector<uint8_t> strip_buffer(nrow * row_bytes);
+            fillStrip(strip_buffer.data(), row, nrow);
+            if (!compressTiffStrip(compression, strip_buffer.data(), strip_buffer.size(),
+                                   &compressed_strips[strip])) {
+                failed = true;
+            }
+        });
+        if (failed) {
+            throw std::runtime_error("Failed to compress TIFF strip.");
+        }
+        for (int strip = 0; strip < strips; strip++) {
+            if (TIFFWriteRawStrip(tif, strip, compressed_strips[strip].data(), compressed_strips[strip].size()) < 0) {
+                throw std::runtime_error("Failed to write TIFF strip.");
+            }
+        }
+        return;
+    }
+
+    auto_ptr<uint8_t> tiffbuf((uint8_t*)_TIFFmalloc(TIFFStripSize(tif)),
+                              [](uint8_t* tiffbuf) { _TIFFfree(tiffbuf); });
 
     if (tiffbuf) {
         for (int row = 0; (row < height); row += rowsperstrip) {
-            uint32_t nrow = (row + rowsperstrip) > height ? nrow = height - row : rowsperstrip;
+            const int nrow = std::min((int) rowsperstrip, height - row);
             tstrip_t strip = TIFFComputeStrip(tif, row, 0);
-            tsize_t bi = 0;
-            for (int y = 0; y < nrow; ++y) {
-                for (int x = 0; x < width; ++x) {
-                    for (int c = 0; c < pixel_channels; c++) {
-                        tiffbuf[bi++] = row_pointer(row + y)[pixel_channels * x + c];
-                    }
-                }
-            }
-            if (TIFFWriteEncodedStrip(tif, strip, tiffbuf, bi * sizeof(T)) < 0) {
+            fillStrip(tiffbuf, row, nrow);
+            if (TIFFWriteEncodedStrip(tif, strip, tiffbuf, nrow * row_bytes) < 0) {
                 throw std::runtime_error("Failed to encode TIFF strip.");
             }
         }
@@ -252,9 +579,253 @@ void write_tiff_file(const std::string& filename, int width, int height, int pix
     }
 }
 
+// Tile layout and sample encoding of a tiled DNG image
+struct dng_tile_format {
+    uint16_t compression = COMPRESSION_NONE;
+    uint16_t predictor = PREDICTOR_NONE;
+    uint16_t sample_format = SAMPLEFORMAT_UINT;
+    uint16_t bitspersample = 16;
+    uint16_t samplesperpixel = 1;
+    bool big_endian = false;
+    uint32_t tile_width = 0;
+    uint32_t tile_height = 0;
+    float float_scale = 1;
+};
+
+// DNG specific predictors, with differences taken across 2 or 4 samples
+#define PREDICTOR_HORIZONTAL_X2 34892
+#define PREDICTOR_HORIZONTAL_X4 34893
+#define PREDICTOR_FLOATINGPOINT_X2 34894
+#define PREDICTOR_FLOATINGPOINT_X4 34895
+
+static inline uint32_t readSample(const uint8_t* data, int bytes, bool big_endian) {
+    uint32_t value = 0;
+    for (int b = 0; b < bytes; b++) {
+        value |= (uint32_t) data[b] << (8 * (big_endian ? bytes - 1 - b : b));
+    }
+    return value;
+}
+
+static inline float halfToFloat(uint16_t half) {
+    const int exponent = (half >> 10) & 0x1f;
+    const int mantissa = half & 0x3ff;
+    float value = exponent == 0    ? std::ldexp((float) mantissa, -24)
+                : exponent == 0x1f ? (mantissa ? NAN : INFINITY)
+                                   : std::ldexp((float) (mantissa | 0x400), exponent - 25);
+    return half & 0x8000 ? -value : value;
+}
+
+// DNG 24 bit floating point: 1 sign bit, 7 exponent bits (bias 63) and 16 mantissa bits
+static inline float fp24ToFloat(uint32_t fp24) {
+    const int exponent = (fp24 >> 16) & 0x7f;
+    const int mantissa = fp24 & 0xffff;
+    float value = exponent == 0    ? std::ldexp((float) mantissa, -78)
+                : exponent == 0x7f ? (mantissa ? NAN : INFINITY)
+                                   : std::ldexp((float) (mantissa | 0x10000), exponent - 79);
+    return fp24 & 0x800000 ? -value : value;
+}
+
+static inline uint16_t floatToLevel(float value, float scale) {
+    value = value * scale + 0.5f;
+    return value >= 65535 ? 65535 : value > 0 ? (uint16_t) value : 0;
+}
+
+// Decode a non-JPEG tile into 'output' as tile_width x tile_height 8 or 16 bit samples, returning the bit depth
+static int decodeDNGTile(const dng_tile_format& format, const uint8_t* tile_data, size_t tile_data_size,
+                         std::vector<uint8_t>* output) {
+    const int bits = format.bitspersample;
+    const int spp = format.samplesperpixel;
+    const size_t row_samples = (size_t) format.tile_width * spp;
+    const size_t row_bytes = (row_samples * bits + 7) / 8;
+    const size_t tile_bytes = row_bytes * format.tile_height;
+
+    std::vector<uint8_t> decompressed;
+    const uint8_t* data = tile_data;
+    if (format.compression == COMPRESSION_ADOBE_DEFLATE || format.compression == COMPRESSION_DEFLATE) {
+        decompressed.resize(tile_bytes);
+        uLongf decompressed_size = (uLongf) tile_bytes;
+        int result = uncompress(decompressed.data(), &decompressed_size, tile_data, (uLong) tile_data_size);
+        // A short or oversized stream is a corrupted tile, not a partial one
+        if (result != Z_OK || decompressed_size != tile_bytes) {
+            throw std::runtime_error("Failed to decompress DNG tile.");
+        }
+        data = decompressed.data();
+    } else if (format.compression != COMPRESSION_NONE) {
+        throw std::runtime_error("Unsupported DNG tile compression: " + std::to_string(format.compression));
+    } else if (tile_data_size < tile_bytes) {
+        decompressed.assign(tile_data, tile_data + tile_data_size);
+        decompressed.resize(tile_bytes);
+        data = decompressed.data();
+    }
+
+    const int predictor_distance = (format.predictor == PREDICTOR_HORIZONTAL_X2 ||
+                                    format.predictor == PREDICTOR_FLOATINGPOINT_X2) ? 2 :
+                                   (format.predictor == PREDICTOR_HORIZONTAL_X4 ||
+                                    format.predictor == PREDICTOR_FLOATINGPOINT_X4) ? 4 : 1;
+    const int stride = predictor_distance * spp;
+
+    if (format.sample_format == SAMPLEFORMAT_IEEEFP) {
+        const bool float_predictor = format.predictor == PREDICTOR_FLOATINGPOINT ||
+                                     format.predictor == PREDICTOR_FLOATINGPOINT_X2 ||
+                                     format.predictor == PREDICTOR_FLOATINGPOINT_X4;
+        if ((bits != 16 && bits != 24 && bits != 32) || (format.predictor != PREDICTOR_NONE && !float_predictor)) {
+            throw std::runtime_error("Unsupported floating point DNG tile format.");
+        }
+        const int bytes = bits / 8;
+        output->resize(row_samples * format.tile_height * sizeof(uint16_t));
+        std::vector<uint8_t> row_buffer(row_bytes);
+        for (uint32_t y = 0; y < format.tile_height; y++) {
+            const uint8_t* row = data + y * row_bytes;
+            uint16_t* output_row = (uint16_t*) output->data() + y * row_samples;
+            const uint8_t* samples = row;
+            bool big_endian = format.big_endian;
+            if (float_predictor) {
+                // Undo the byte differencing, then gather the byte planes (most significant first) into samples
+                std::copy(row, row + row_bytes, row_buffer.begin());
+                for (size_t i = stride; i < row_bytes; i++) {
+                    row_buffer[i] += row_buffer[i - stride];
+                }
+                std::vector<uint8_t> planes(row_buffer);
+                for (size_t i = 0; i < row_samples; i++) {
+                    for (int b = 0; b < bytes; b++) {
+                        row_buffer[i * bytes + b] = planes[b * row_samples + i];
+                    }
+                }
+                samples = row_buffer.data();
+                big_endian = true;
+            }
+            for (size_t i = 0; i < row_samples; i++) {
+                const uint32_t sample = readSample(samples + i * bytes, bytes, big_endian);
+                float value;
+                if (bytes == 2) {
+                    value = halfToFloat((uint16_t) sample);
+                } else if (bytes == 3) {
+                    value = fp24ToFloat(sample);
+                } else {
+                    std::memcpy(&value, &sample, sizeof(float));
+                }
+                output_row[i] = floatToLevel(value, format.float_scale);
+            }
+        }
+        return 16;
+    }
+
+    const bool horizontal_predictor = format.predictor == PREDICTOR_HORIZONTAL ||
+                                      format.predictor == PREDICTOR_HORIZONTAL_X2 ||
+                                      format.predictor == PREDICTOR_HORIZONTAL_X4;
+    if (format.predictor != PREDICTOR_NONE && (!horizontal_predictor || (bits != 8 && bits != 16))) {
+        throw std::runtime_error("Unsupported DNG predictor: " + std::to_string(format.predictor));
+    }
+
+    if (bits == 8) {
+        output->assign(data, data + tile_bytes);
+        if (horizontal_predictor) {
+            for (uint32_t y = 0; y < format.tile_height; y++) {
+                uint8_t* row = output->data() + y * row_samples;
+                for (size_t i = stride; i < row_samples; i++) {
+                    row[i] += row[i - stride];
+                }
+            }
+        }
+        return 8;
+    }
+
+    output->resize(row_samples * format.tile_height * sizeof(uint16_t));
+    uint16_t* output_samples = (uint16_t*) output->data();
+    if (bits == 16) {
+        for (uint32_t y = 0; y < format.tile_height; y++) {
+            const uint8_t* row = data + y * row_bytes;
+            uint16_t* output_row = output_samples + y * row_samples;
+            for (size_t i = 0; i < row_samples; i++) {
+                output_row[i] = (uint16_t) readSample(row + 2 * i, 2, format.big_endian);
+            }
+            if (horizontal_predictor) {
+                for (size_t i = stride; i < row_samples; i++) {
+                    output_row[i] += output_row[i - stride];
+                }
+            }
+        }
+    } else if (bits == 10 || bits == 12 || bits == 14) {
+        unpackTiffRows(output_samples, data, (int) row_samples, format.tile_height, bits);
+    } else {
+        throw std::runtime_error("tiff_bitspersample " + std::to_string(bits) + " not supported.");
+    }
+    return 16;
+}
+
+// Decode the image tiles intersecting the output rectangle (crop_x, crop_y, output_width, output_height)
+// concurrently, handing each one to the strip processor at its position in the image
+static void readDNGTiles(TIFF* tif, const dng_tile_format& format, uint32_t width, uint32_t height,
+                         int crop_x, int crop_y, int output_width, int output_height,
+                         const tiff_strip_procesor& process_tiff_strip) {
+    const uint32_t tileCountX = (width + format.tile_width - 1) / format.tile_width;
+    const uint32_t tileCountY = (height + format.tile_height - 1) / format.tile_height;
+
+    const uint32_t firstTileX = std::max(crop_x, 0) / format.tile_width;
+    const uint32_t firstTileY = std::max(crop_y, 0) / format.tile_height;
+    const uint32_t lastTileX = std::min((uint32_t) std::max(crop_x + output_width - 1, 0) / format.tile_width, tileCountX - 1);
+    const uint32_t lastTileY = std::min((uint32_t) std::max(crop_y + output_height - 1, 0) / format.tile_height, tileCountY - 1);
+
+    std::vector<uint32_t> tiles;
+    for (uint32_t tileRow = firstTileY; tileRow <= lastTileY; tileRow++) {
+        for (uint32_t tileColumn = firstTileX; tileColumn <= lastTileX; tileColumn++) {
+            tiles.push_back(tileRow * tileCountX + tileColumn);
+        }
+    }
+
+    // libtiff handles are not thread safe, read the raw tiles upfront
+    std::vector<std::vector<uint8_t>> raw_tiles(tiles.size());
+    for (size_t i = 0; i < tiles.size(); i++) {
+        raw_tiles[i].resize(TIFFGetStrileByteCount(tif, tiles[i]));
+        if (TIFFReadRawTile(tif, tiles[i], raw_tiles[i].data(), raw_tiles[i].size()) < 0) {
+            throw std::runtime_error("Failed to read TIFF tile " + std::to_string(tiles[i]));
+        }
+    }
+
+    parallel_for((int) tiles.size(), parallel_threads(0), [&](int i) {
+        const uint32_t tile = tiles[i];
+        const uint32_t tileX = format.tile_width * (tile % tileCountX);
+        const uint32_t tileY = format.tile_height * (tile / tileCountX);
+        const uint32_t tileWidth = std::min(tileX + format.tile_width, width) - tileX;
+        const uint32_t tileHeight = std::min(tileY + format.tile_height, height) - tileY;
+
+        std::vector<uint8_t> decoded;
+        int decoded_bits = 16;
+        uint8_t* tilePixels = nullptr;
+        dng_spooler spooler;
+        const auto& raw_tile = raw_tiles[i];
+        if (format.compression == COMPRESSION_JPEG) {
+            // Used Adobe's version of libjpeg lossless codec
+            dng_stream stream((uint8_t *) raw_tile.data(), raw_tile.size());
+            uint32_t decodedSize = format.tile_width * format.tile_height * sizeof(uint16_t);
+            DecodeLosslessJPEG(stream, spooler, decodedSize, decodedSize, false, raw_tile.size());
+            tilePixels = (uint8_t *) spooler.data();
+        } else {
+            decoded_bits = decodeDNGTile(format, raw_tile.data(), raw_tile.size(), &decoded);
+            tilePixels = decoded.data();
+        }
+
+        // Drop the padding of the tiles at the right edge of the image
+        const size_t pixel_bytes = format.samplesperpixel * decoded_bits / 8;
+        if (tileWidth < format.tile_width) {
+            for (uint32_t y = 1; y < tileHeight; y++) {
+                std::memmove(tilePixels + y * tileWidth * pixel_bytes, tilePixels + y * format.tile_width * pixel_bytes,
+                             tileWidth * pixel_bytes);
+            }
+        }
+
+        process_tiff_strip(decoded_bits, format.samplesperpixel, /*row=*/ tileY,
+                           /*strip_width=*/ tileWidth, /*strip_height=*/ tileHeight,
+                           /*crop_x=*/ crop_x - (int) tileX, /*crop_y=*/ crop_y, tilePixels);
+    });
+}
+
+// Margin added around a region of interest, so that the region can be demosaiced without edge artifacts
+static const int kDemosaicHalo = 16;
+
 void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bit_depth, gls::tiff_metadata* dng_metadata, gls::tiff_metadata* exif_metadata,
                    std::function<bool(int width, int height)> image_allocator,
-                   tiff_strip_procesor process_tiff_strip) {
+                   tiff_strip_procesor process_tiff_strip, int* roi) {
     augment_libtiff_with_custom_tags();
 
     auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "r"),
@@ -300,7 +871,8 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
 
         uint16_t tiff_sampleformat = SAMPLEFORMAT_UINT;
         TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &tiff_sampleformat);
-        if (tiff_sampleformat != SAMPLEFORMAT_UINT) {
+        // Floating point data is only found in tiled DNG files
+        if (tiff_sampleformat != SAMPLEFORMAT_UINT && !(tiff_sampleformat == SAMPLEFORMAT_IEEEFP && TIFFIsTiled(tif))) {
             throw std::runtime_error("can not read sample format other than uint: " + std::to_string(tiff_sampleformat));
         }
 
@@ -338,6 +910,32 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
             crop_y += active_area[0];
         }
 
+        if (roi && roi[2] > 0 && roi[3] > 0) {
+            // Grow the region by the demosaic halo, keeping its origin aligned with the CFA pattern
+            const auto cfa_repeat = getVector<uint16_t>(*dng_metadata, TIFFTAG_CFAREPEATPATTERNDIM);
+            const int cfa_rows = cfa_repeat.size() == 2 ? cfa_repeat[0] : 2;
+            const int cfa_cols = cfa_repeat.size() == 2 ? cfa_repeat[1] : 2;
+
+            int x0 = std::max(roi[0] - kDemosaicHalo, 0);
+            int y0 = std::max(roi[1] - kDemosaicHalo, 0);
+            x0 -= x0 % cfa_cols;
+            y0 -= y0 % cfa_rows;
+            const int x1 = std::min(roi[0] + roi[2] + kDemosaicHalo, (int) image_width);
+            const int y1 = std::min(roi[1] + roi[3] + kDemosaicHalo, (int) image_height);
+            if (x1 <= x0 || y1 <= y0) {
+                throw std::runtime_error("DNG region of interest outside of the image.");
+            }
+
+            roi[0] = x0;
+            roi[1] = y0;
+            roi[2] = x1 - x0;
+            roi[3] = y1 - y0;
+            crop_x += x0;
+            crop_y += y0;
+            image_width = roi[2];
+            image_height = roi[3];
+        }
+
         uint16_t orientation;
         TIFFGetField(tif, TIFFTAG_ORIENTATION, &orientation);
         printf("orientation: %d\n", orientation);
@@ -357,50 +955,33 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
 
                 printf("tileWidth: %d, tileHeight: %d\n", maxTileWidth, maxTileHeight);
 
-                tmsize_t tileSize = TIFFTileSize(tif);
-                uint32_t tileCount = TIFFNumberOfTiles(tif);
-                uint32_t tileCountX = (width + maxTileWidth - 1) / maxTileWidth;
-                auto_ptr<uint16_t> tiffbuf((uint16_t*)_TIFFmalloc(tileSize),
-                                           [](uint16_t* buf) { _TIFFfree(buf); });
-
-                auto_ptr<uint16_t> imagebuf((uint16_t*)_TIFFmalloc(width * height * sizeof(uint16_t)),
-                                            [](uint16_t* buf) { _TIFFfree(buf); });
-
-                if (compression == COMPRESSION_JPEG) {
-                    for (uint32_t tile = 0; tile < tileCount; tile++) {
-                        uint32_t tileX = maxTileWidth * (tile % tileCountX);
-                        uint32_t tileY = maxTileHeight * (tile / tileCountX);
-
-                        uint32_t tileWidth = std::min(tileX + maxTileWidth, width) - tileX;
-                        uint32_t tileHeight = std::min(tileY + maxTileHeight, height) - tileY;
-
-                        tmsize_t tileBytes = TIFFReadRawTile(tif, tile, (uint8_t *) tiffbuf.get(), (tsize_t) -1);
-                        if (tileBytes < 0) {
-                            throw std::runtime_error("Failed to read TIFF tile " + std::to_string(tile));
-                        } else {
-                            // Used Adobe's version of libjpeg lossless codec
-                            dng_stream stream((uint8_t *) tiffbuf.get(), tileSize);
-                            dng_spooler spooler;
-                            uint32_t decodedSize = maxTileWidth * maxTileHeight * sizeof(uint16_t);
-                            DecodeLosslessJPEG(stream, spooler, decodedSize, decodedSize, false, tileSize);
-
-                            uint16_t *tilePixels = (uint16_t *) spooler.data();
-                            for (int y = 0; y < tileHeight; y++) {
-                                for (int x = 0; x < tileWidth; x++) {
-                                    imagebuf[(tileY + y) * width + tileX + x] = tilePixels[y * maxTileWidth + x];
-                                }
-                            }
-                        }
+                dng_tile_format format = {
+                    .compression = compression,
+                    .sample_format = tiff_sampleformat,
+                    .bitspersample = tiff_bitspersample,
+                    .samplesperpixel = tiff_samplesperpixel,
+                    .big_endian = TIFFIsBigEndian(tif) != 0,
+                    .tile_width = maxTileWidth,
+                    .tile_height = maxTileHeight,
+                };
+                if (compression != COMPRESSION_NONE && compression != COMPRESSION_JPEG) {
+                    TIFFGetField(tif, TIFFTAG_PREDICTOR, &format.predictor);
+                }
+                if (tiff_sampleformat == SAMPLEFORMAT_IEEEFP) {
+                    // Map floating point data to the full 16 bit range, and update the levels to match
+                    const auto white_level = getVector<uint32_t>(*dng_metadata, TIFFTAG_WHITELEVEL);
+                    format.float_scale = 0xffff / (white_level.empty() ? 1.0f : (float) white_level[0]);
+                    auto black_level = getVector<float>(*dng_metadata, TIFFTAG_BLACKLEVEL);
+                    for (auto& level : black_level) {
+                        level *= format.float_scale;
+                    }
+                    (*dng_metadata)[TIFFTAG_WHITELEVEL] = std::vector<uint32_t>{ 0xffff };
+                    if (!black_level.empty()) {
+                        (*dng_metadata)[TIFFTAG_BLACKLEVEL] = black_level;
                     }
-
-                    // The output of the JPEG decoder is always 16 bits
-                    process_tiff_strip(/*tiff_bitspersample=*/ 16, tiff_samplesperpixel, 0,
-                                       /*strip_width=*/ width, /*strip_height=*/ height,
-                                       /*crop_x=*/ crop_x, /*crop_y=*/ crop_y,
-                                       (uint8_t *) imagebuf.get());
-                } else {
-                    throw std::runtime_error("Not implemented yet...");
                 }
+
+                readDNGTiles(tif, format, width, height, crop_x, crop_y, image_width, image_height, process_tiff_strip);
             } else {
                 if (compression == COMPRESSION_JPEG) {
                     // DNG data is losslessly compressed
@@ -443,9 +1024,16 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
                     }
                     _TIFFfree(tiffbuf);
                 } else {
-                    // No compreession, read as a plain TIFF file
-
-                    readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel, process_tiff_strip);
+                    // No compreession, read as a plain TIFF file, applying the crop to the strips
+
+                    readTiffImageData(tif, width, height, tiff_bitspersample, tiff_samplesperpixel,
+                                      /*scale_to_16_bits=*/ false,
+                                      [&](int tiff_bitspersample, int tiff_samplesperpixel, int row, int strip_width,
+                                          int strip_height, int /*crop_x*/, int /*crop_y*/, uint8_t *tiff_buffer) {
+                                          return process_tiff_strip(tiff_bitspersample, tiff_samplesperpixel, row,
+                                                                    strip_width, strip_height, crop_x, crop_y,
+                                                                    tiff_buffer);
+                                      });
                 }
             }
         }
@@ -457,15 +1045,43 @@ void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bi
     }
 }
 
+// Number of significant bits of the raw data: the explicit bit depth if given, otherwise the one of the white level.
+// Grown if needed to cover the actual sample values, so that the file is always lossless.
+static int dngSampleBitDepth(int width, int height, int pixel_channels, int pixel_bit_depth,
+                             const tiff_metadata* dng_metadata,
+                             std::function<uint16_t*(int row)> row_pointer, int bit_depth) {
+    if (bit_depth <= 0) {
+        bit_depth = pixel_bit_depth;
+        if (dng_metadata) {
+            const auto white_level = getVector<uint32_t>(*dng_metadata, TIFFTAG_WHITELEVEL);
+            if (!white_level.empty() && white_level[0] > 0) {
+                bit_depth = std::bit_width(*std::max_element(white_level.begin(), white_level.end()));
+            }
+        }
+    }
+
+    uint16_t max_value = 0;
+    for (int y = 0; y < height && width > 0; y++) {
+        const uint16_t* row = row_pointer(y);
+        max_value = std::max(max_value, *std::max_element(row, row + width * pixel_channels));
+    }
+    return std::clamp(std::max(bit_depth, (int) std::bit_width(max_value)), 2, pixel_bit_depth);
+}
+
 void write_dng_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
                     tiff_compression compression, const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
-                    std::function<uint16_t*(int row)> row_pointer) {
+                    std::function<uint16_t*(int row)> row_pointer, int bit_depth) {
     if (compression != COMPRESSION_NONE &&
         compression != COMPRESSION_JPEG &&
         compression != COMPRESSION_ADOBE_DEFLATE) {
         throw std::runtime_error("Only lossles JPEG and ADOBE_DEFLATE compression schemes are supported for DNG files. (" + std::to_string(compression) + ")");
     }
 
+    // Lossless JPEG encodes at the exact sample precision, uncompressed and Deflate data is packed at 10, 12 or 14 bits
+    bit_depth = dngSampleBitDepth(width, height, pixel_channels, pixel_bit_depth, dng_metadata, row_pointer, bit_depth);
+    const int bits_per_sample = compression == COMPRESSION_JPEG ? bit_depth
+                              : bit_depth <= 10 ? 10 : bit_depth <= 12 ? 12 : bit_depth <= 14 ? 14 : 16;
+
     augment_libtiff_with_custom_tags();
 
     auto_ptr<TIFF> tif(TIFFOpen(filename.c_str(), "w"),
@@ -479,7 +1095,7 @@ void write_dng_file(const std::string& filename, int width, int height, int pixe
         TIFFSetField(tif, TIFFTAG_DNGBACKWARDVERSION, "\01\03\00\00");
         TIFFSetField(tif, TIFFTAG_SUBFILETYPE, 0);
         TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
-        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bits_per_sample);
 
         uint16_t orientation = ORIENTATION_TOPLEFT;
         if (dng_metadata) {
@@ -536,7 +1152,7 @@ void write_dng_file(const std::string& filename, int width, int height, int pixe
             dng_stream out_stream((uint8_t*) outputBuffer.data(), outputBuffer.size() * sizeof(uint16_t));
 
             EncodeLosslessJPEG(row_pointer(0), height, width,
-                               /*srcChannels=*/ 1, /*srcBitDepth=*/ 16, // TODO: reflect the actual bit depth
+                               /*srcChannels=*/ 1, /*srcBitDepth=*/ bits_per_sample,
                                /*srcRowStep=*/ width, /*srcColStep=*/ 1, out_stream);
 
             if (TIFFWriteRawStrip(tif, 0, outputBuffer.data(), out_stream.Position()) < 0) {
@@ -544,7 +1160,7 @@ void write_dng_file(const std::string& filename, int width, int height, int pixe
             }
             std::cout << "Wrote " << out_stream.Position() << " compressed image bytes." << std::endl;
         } else {
-            writeTiffImageData(tif, width, height, pixel_channels, pixel_bit_depth, row_pointer);
+            writeTiffImageData(tif, width, height, pixel_channels, bits_per_sample, row_pointer);
         }
 
         // Write directory to file
@@ -33,6 +33,7 @@ typedef enum tiff_compression {
 
 class tiff_metadata;
 
+// Strips are decoded concurrently, the strip processor can be invoked from multiple threads for different strips
 typedef std::function<bool(int tiff_bitspersample, int tiff_samplesperpixel, int row, int strip_width, int strip_height,
                            int crop_x, int crop_y, uint8_t *tiff_buffer)> tiff_strip_procesor;
 
@@ -44,13 +45,18 @@ template <typename T>
 void write_tiff_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
                      tiff_compression compression, tiff_metadata* metadata, std::function<T*(int row)> row_pointer);
 
+// roi: optional region of interest { x, y, width, height } within the cropped image. On return it holds the region
+// actually decoded: grown by a demosaic halo and with the origin aligned to the CFA pattern, so that the CFA phase
+// of the result is the same as the full image. For tiled files only the tiles intersecting the region are decoded.
 void read_dng_file(const std::string& filename, int pixel_channels, int pixel_bit_depth, tiff_metadata* dng_metadata,
                    tiff_metadata* exif_metadata, std::function<bool(int width, int height)> image_allocator,
-                   tiff_strip_procesor process_tiff_strip);
+                   tiff_strip_procesor process_tiff_strip, int* roi = nullptr);
 
+// bit_depth: number of significant bits of the raw samples, derived from TIFFTAG_WHITELEVEL when not given.
+// Lossless JPEG data is encoded at that precision, uncompressed and Deflate data is packed at 10, 12 or 14 bits.
 void write_dng_file(const std::string& filename, int width, int height, int pixel_channels, int pixel_bit_depth,
                     tiff_compression compression, const tiff_metadata* dng_metadata, const tiff_metadata* exif_metadata,
-                    std::function<uint16_t*(int row)> row_pointer);
+                    std::function<uint16_t*(int row)> row_pointer, int bit_depth = 0);
 
 }  // namespace gls
 
@@ -16,7 +16,9 @@
 #ifndef gls_linalg_h
 #define gls_linalg_h
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <span>
 #include <vector>
 
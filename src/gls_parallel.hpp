@@ -0,0 +1,56 @@
+// Copyright (c) 2021-2022 Glass Imaging Inc.
+// Author: Fabio Riccardi <fabio@glass-imaging.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef gls_parallel_h
+#define gls_parallel_h
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+
+namespace gls {
+
+// Number of worker threads to use for a requested thread count, 0 means all available cores
+static inline int parallel_threads(int threads) {
+    return threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// Run function(index) for index in [0, count) on up to 'threads' concurrent workers,
+// exceptions thrown by the function are rethrown once all workers are done
+static inline void parallel_for(int count, int threads, const std::function<void(int index)>& function) {
+    std::atomic<int> next_index = 0;
+    auto worker = [&]() {
+        for (int index = next_index++; index < count; index = next_index++) {
+            function(index);
+        }
+    };
+    std::vector<std::future<void>> workers;
+    for (int i = 0; i < std::min(threads, count); i++) {
+        workers.push_back(std::async(std::launch::async, worker));
+    }
+    for (auto& w : workers) {
+        w.wait();
+    }
+    for (auto& w : workers) {
+        w.get();
+    }
+}
+
+}  // namespace gls
+
+#endif /* gls_parallel_h */
@@ -15,12 +15,185 @@
 
 #include "gls_tiff_metadata.hpp"
 
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
 
 #define DEBUG_TIFF_TAGS 1
 
 namespace gls {
 
+// Index of a type in the tiff_metadata_item variant
+template <typename T, size_t I = 0>
+constexpr size_t item_index() {
+    if constexpr (std::is_same_v<std::variant_alternative_t<I, tiff_metadata_item>, T>) {
+        return I;
+    } else {
+        return item_index<T, I + 1>();
+    }
+}
+
+template <typename T>
+struct is_vector : std::false_type {};
+
+template <typename T>
+struct is_vector<std::vector<T>> : std::true_type {};
+
+template <size_t I>
+tiff_metadata_item decodeRawItem(const uint8_t* data, uint32_t count) {
+    typedef std::variant_alternative_t<I, tiff_metadata_item> T;
+    if constexpr (std::is_same_v<T, std::string>) {
+        return std::string((const char*) data, count);
+    } else if constexpr (is_vector<T>::value) {
+        T values(count);
+        memcpy(values.data(), data, count * sizeof(typename T::value_type));
+        return values;
+    } else {
+        T value;
+        memcpy(&value, data, sizeof(T));
+        return value;
+    }
+}
+
+// Size in bytes of a raw element of a tiff_metadata_item alternative
+template <size_t I>
+constexpr size_t rawElementSize() {
+    typedef std::variant_alternative_t<I, tiff_metadata_item> T;
+    if constexpr (std::is_same_v<T, std::string>) {
+        return 1;
+    } else if constexpr (is_vector<T>::value) {
+        return sizeof(typename T::value_type);
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <size_t... I>
+size_t rawElementSize(size_t type, std::index_sequence<I...>) {
+    static const size_t sizes[] = { rawElementSize<I>()... };
+    return sizes[type];
+}
+
+template <size_t... I>
+tiff_metadata_item decodeRawItem(size_t type, const uint8_t* data, uint32_t count, std::index_sequence<I...>) {
+    typedef tiff_metadata_item (*decoder)(const uint8_t* data, uint32_t count);
+    static const decoder decoders[] = { decodeRawItem<I>... };
+    return decoders[type](data, count);
+}
+
+const tiff_metadata::value_type& tiff_metadata::materialize(const entry& e) const {
+    if (!e.value) {
+        e.value = value_type(e.tag, decodeRawItem(e.type, _arena.data() + e.offset, e.count,
+                                                  std::make_index_sequence<std::variant_size_v<tiff_metadata_item>>()));
+    }
+    return *e.value;
+}
+
+std::pair<tiff_metadata::iterator, bool> tiff_metadata::insert(const value_type& value) {
+    auto e = lower_bound(value.first);
+    if (e != _entries.end() && e->tag == value.first) {
+        return { iterator(this, e), false };
+    }
+    e = _entries.insert(e, { .tag = value.first, .type = (uint32_t) value.second.index(), .value = value });
+    return { iterator(this, e), true };
+}
+
+bool tiff_metadata::insert_raw(ttag_t tag, size_t type, const void* data, uint32_t count, uint32_t size) {
+    auto e = lower_bound(tag);
+    if (e != _entries.end() && e->tag == tag) {
+        return false;
+    }
+    const auto offset = (uint32_t) _arena.size();
+    _arena.insert(_arena.end(), (const uint8_t*) data, (const uint8_t*) data + size);
+    _entries.insert(e, { .tag = tag, .type = (uint32_t) type, .count = count, .offset = offset, .size = size });
+    return true;
+}
+
+bool tiff_metadata::copy_entry(const tiff_metadata& source, ttag_t tag) {
+    const auto s = source.lower_bound(tag);
+    if (s == source._entries.end() || s->tag != tag) {
+        return false;
+    }
+    if (s->value) {
+        // Decoded entries may have been modified, copy the decoded value
+        return insert(*s->value).second;
+    }
+    return insert_raw(tag, s->type, source._arena.data() + s->offset, s->count, s->size);
+}
+
+tiff_metadata_item& tiff_metadata::operator[](ttag_t tag) {
+    auto e = lower_bound(tag);
+    if (e == _entries.end() || e->tag != tag) {
+        e = _entries.insert(e, { .tag = tag, .value = value_type(tag, tiff_metadata_item()) });
+    }
+    return const_cast<value_type&>(materialize(*e)).second;
+}
+
+std::vector<uint8_t> tiff_metadata::serialize() const {
+    std::vector<uint8_t> data;
+    auto append = [&data](const void* bytes, size_t size) {
+        data.insert(data.end(), (const uint8_t*) bytes, (const uint8_t*) bytes + size);
+    };
+    for (const auto& e : _entries) {
+        uint32_t type = e.type;
+        uint32_t count = e.count;
+        uint32_t size = e.size;
+        const uint8_t* bytes = _arena.data() + e.offset;
+        if (e.value) {
+            // Decoded entries may have been modified, write out the decoded value
+            type = (uint32_t) e.value->second.index();
+            std::visit([&](const auto& item) {
+                typedef std::decay_t<decltype(item)> T;
+                if constexpr (std::is_same_v<T, std::string> || is_vector<T>::value) {
+                    bytes = (const uint8_t*) item.data();
+                    count = (uint32_t) item.size();
+                    size = (uint32_t) (item.size() * sizeof(typename T::value_type));
+                } else {
+                    bytes = (const uint8_t*) &item;
+                    count = 1;
+                    size = sizeof(T);
+                }
+            }, e.value->second);
+        }
+        const uint32_t header[4] = { (uint32_t) e.tag, type, count, size };
+        append(header, sizeof(header));
+        append(bytes, size);
+    }
+    return data;
+}
+
+void tiff_metadata::deserialize(const uint8_t* data, size_t size) {
+    size_t position = 0;
+    while (position < size) {
+        uint32_t header[4];
+        if (position + sizeof(header) > size) {
+            throw std::runtime_error("Truncated metadata.");
+        }
+        memcpy(header, data + position, sizeof(header));
+        position += sizeof(header);
+
+        const auto [tag, type, count, item_size] = header;
+        constexpr size_t item_types = std::variant_size_v<tiff_metadata_item>;
+        if (type >= item_types || position + item_size > size ||
+            count * rawElementSize(type, std::make_index_sequence<item_types>()) != item_size) {
+            throw std::runtime_error("Corrupted metadata entry for tag " + std::to_string(tag) + ".");
+        }
+        insert_raw(tag, type, data + position, count, item_size);
+        position += item_size;
+    }
+}
+
+bool tiff_metadata::erase(ttag_t tag) {
+    const auto e = lower_bound(tag);
+    if (e == _entries.end() || e->tag != tag) {
+        return false;
+    }
+    _entries.erase(e);
+    return true;
+}
+
 struct TiffFieldInfo {
     const ttag_t        field_tag;          /* field's tag */
     const int           field_readcount;    /* read count/TIFF_VARIABLE/TIFF_SPP */
@@ -55,29 +228,25 @@ bool readMetaDataItem(TIFF* tif, const TIFFField* tf, tiff_metadata* metadata) {
             count = field_readcount;
         }
 
-        std::vector<T> values;
-        values.resize(count);
-        for (unsigned i = 0; i < count; i++) {
-            values[i] = data[i];
-        }
 #ifdef DEBUG_TIFF_TAGS
-        std::cout << "New metadata vector (" << values.size() << ") " << getFieldName(tf) << ": ";
-        for (int i = 0; i < values.size() && i < 10; i++) {
-            const auto& v = values[i];
+        std::cout << "New metadata vector (" << count << ") " << getFieldName(tf) << ": ";
+        for (size_t i = 0; i < count && i < 10; i++) {
+            const auto& v = data[i];
             if (sizeof(v) == 1) {
                 std::cout << (int) v;
             } else {
                 std::cout << v;
             }
-            if (i < 9 && i < values.size() - 1) {
+            if (i < 9 && i + 1 < count) {
                 std::cout << ", ";
-            } else if (i == 9 && i < values.size() - 1) {
+            } else if (i == 9 && i + 1 < count) {
                 std::cout << "...";
             }
         }
         std::cout << std::endl;
 #endif
-        metadata->insert({ field_tag, values });
+        // Keep the raw values, the vector is only created on first access
+        metadata->insert_raw(field_tag, item_index<std::vector<T>>(), data, (uint32_t) count, (uint32_t) (count * sizeof(T)));
         return true;
     } else if (field_readcount == 1) {
         T data;
@@ -85,7 +254,7 @@ bool readMetaDataItem(TIFF* tif, const TIFFField* tf, tiff_metadata* metadata) {
 #ifdef DEBUG_TIFF_TAGS
         std::cout << "New metadata scalar " << getFieldName(tf) << ": " << data << std::endl;
 #endif
-        metadata->insert({ field_tag, data });
+        metadata->insert_raw(field_tag, item_index<T>(), &data, 1, sizeof(T));
         return true;
     }
     return false;
@@ -95,7 +264,7 @@ bool readMetaDataString(TIFF* tif, const TIFFField* tf, tiff_metadata* metadata)
     const auto field_tag = TIFFFieldTag(tf);
     const auto field_readcount = TIFFFieldReadCount(tf);
 
-    const char* data;
+    const char* data = nullptr;
 
     if (field_readcount == TIFF_VARIABLE2) {
         // Happens with undefined ASCII tags which are defaulted to TIFF_VARIABLE2 by libtiff
@@ -105,10 +274,15 @@ bool readMetaDataString(TIFF* tif, const TIFFField* tf, tiff_metadata* metadata)
         TIFFGetField(tif, field_tag, &data);
     }
 
+    if (data == nullptr) {
+        return false;
+    }
+
 #ifdef DEBUG_TIFF_TAGS
     std::cout << "New metadata string " << getFieldName(tf) << ": " << data << std::endl;
 #endif
-    metadata->insert({ field_tag, data });
+    const auto length = (uint32_t) strlen(data);
+    metadata->insert_raw(field_tag, item_index<std::string>(), data, length, length);
 
     return true;
 }
@@ -398,11 +572,11 @@ static void registerCustomTIFFTags(TIFF *tif) {
 }
 
 void augment_libtiff_with_custom_tags() {
-    static bool first_time = true;
-    if (first_time) {
+    // Files may be opened concurrently, register the extender exactly once
+    static std::once_flag registered;
+    std::call_once(registered, [] {
         parent_extender = TIFFSetTagExtender( registerCustomTIFFTags );
-        first_time = false;
-    }
+    });
 }
 
 }  // namespace gls
@@ -16,10 +16,11 @@
 #ifndef TiffMetadata_hpp
 #define TiffMetadata_hpp
 
+#include <algorithm>
+#include <optional>
 #include <string>
 #include <variant>
 #include <vector>
-#include <unordered_map>
 
 #include <tiffio.h>
 
@@ -30,7 +31,95 @@ typedef std::variant<uint8_t, uint16_t, uint32_t, int8_t, int16_t, int32_t, floa
                      std::vector<int8_t>, std::vector<int16_t>, std::vector<int32_t>,
                      std::vector<float>, std::vector<double>, std::string> tiff_metadata_item;
 
-class tiff_metadata: public std::unordered_map<ttag_t, tiff_metadata_item> { };
+// TIFF tag metadata, stored as a vector of entries sorted by tag. Tags read from a file keep their raw values in a
+// single arena and are only converted to a tiff_metadata_item when first accessed, which keeps reading files with
+// large tags (maker notes, opcode lists, hue/sat maps) and copying metadata between files cheap.
+// Accessors that decode entries mutate internal state: a tiff_metadata instance must not be shared across threads.
+class tiff_metadata {
+   public:
+    typedef std::pair<ttag_t, tiff_metadata_item> value_type;
+
+   private:
+    struct entry {
+        ttag_t tag;
+        uint32_t type;     // tiff_metadata_item alternative of the raw data
+        uint32_t count;    // number of raw elements
+        uint32_t offset;   // raw data offset in the arena
+        uint32_t size;     // raw data size in bytes
+        mutable std::optional<value_type> value;  // decoded value, for raw entries only after the first access
+    };
+
+    std::vector<entry> _entries;
+    std::vector<uint8_t> _arena;
+
+    const value_type& materialize(const entry& e) const;
+
+    std::vector<entry>::const_iterator lower_bound(ttag_t tag) const {
+        return std::lower_bound(_entries.begin(), _entries.end(), tag,
+                                [](const entry& e, ttag_t tag) { return e.tag < tag; });
+    }
+
+    std::vector<entry>::iterator lower_bound(ttag_t tag) {
+        return std::lower_bound(_entries.begin(), _entries.end(), tag,
+                                [](const entry& e, ttag_t tag) { return e.tag < tag; });
+    }
+
+    template <typename Entry, typename Value>
+    class basic_iterator {
+        const tiff_metadata* _metadata;
+        Entry _entry;
+
+       public:
+        basic_iterator(const tiff_metadata* metadata, Entry entry) : _metadata(metadata), _entry(entry) {}
+
+        Value& operator*() const { return const_cast<Value&>(_metadata->materialize(*_entry)); }
+        Value* operator->() const { return &**this; }
+        basic_iterator& operator++() { ++_entry; return *this; }
+        bool operator==(const basic_iterator& other) const { return _entry == other._entry; }
+        bool operator!=(const basic_iterator& other) const { return _entry != other._entry; }
+    };
+
+   public:
+    typedef basic_iterator<std::vector<entry>::iterator, value_type> iterator;
+    typedef basic_iterator<std::vector<entry>::const_iterator, const value_type> const_iterator;
+
+    iterator begin() { return iterator(this, _entries.begin()); }
+    iterator end() { return iterator(this, _entries.end()); }
+    const_iterator begin() const { return const_iterator(this, _entries.begin()); }
+    const_iterator end() const { return const_iterator(this, _entries.end()); }
+
+    size_t size() const { return _entries.size(); }
+    bool empty() const { return _entries.empty(); }
+
+    iterator find(ttag_t tag) {
+        const auto e = lower_bound(tag);
+        return iterator(this, e != _entries.end() && e->tag == tag ? e : _entries.end());
+    }
+
+    const_iterator find(ttag_t tag) const {
+        const auto e = lower_bound(tag);
+        return const_iterator(this, e != _entries.end() && e->tag == tag ? e : _entries.end());
+    }
+
+    // Like std::map::insert, an existing entry for the same tag is left untouched
+    std::pair<iterator, bool> insert(const value_type& value);
+
+    // Adds an entry for count raw elements of the given tiff_metadata_item alternative, decoded on first access
+    bool insert_raw(ttag_t tag, size_t type, const void* data, uint32_t count, uint32_t size);
+
+    // Copies an entry from another metadata set, without decoding raw data
+    bool copy_entry(const tiff_metadata& source, ttag_t tag);
+
+    tiff_metadata_item& operator[](ttag_t tag);
+
+    bool erase(ttag_t tag);
+
+    // Flat binary image of all entries, for storing metadata along with cached image data
+    std::vector<uint8_t> serialize() const;
+
+    // Adds the entries of a serialized metadata set, existing entries are left untouched
+    void deserialize(const uint8_t* data, size_t size);
+};
 
 void readExifMetaData(TIFF* tif, tiff_metadata* metadata);
 